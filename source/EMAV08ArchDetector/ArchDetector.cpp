@@ -121,6 +121,8 @@ using namespace std;
 #include "MorphBlobDetector.h"
 #include "HoughTransform.h"
 #include "HorizonDetector.h"
+#include "testCircle.h"
+#include "BlobTracker.h"
 
 
 
@@ -133,6 +135,7 @@ ArchDetector::ArchDetector() {
 	rhoDistanceMin = 4;
 	rhoDistanceMax = 11;
 	allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage = false;
+	setDefaults();
 }
 
 ArchDetector::ArchDetector(int thetaResolutionDegrees, int rhoResolution, int angleDegreesMargin, int rhoDistanceMin, int rhoDistanceMax, bool allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage) {
@@ -142,10 +145,245 @@ ArchDetector::ArchDetector(int thetaResolutionDegrees, int rhoResolution, int an
 	this->rhoDistanceMin = rhoDistanceMin;
 	this->rhoDistanceMax = rhoDistanceMax;
 	this->allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage = allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage;
+	setDefaults();
+}
+
+//the defaults of the options (see the setters), and the members created by init
+void ArchDetector::setDefaults() {
+	fineFactor = 1;
+	fineHough = NULL;
+	refineArchLinesEnabled = false;
+	showAll = true;
+	blobDetectionInterval = 1;
+	blobDetectionAlternateHalves = false;
+	houghHalfLifeFrames = 0;
+	horizonTrackingBandRows = 0;
+	horizonTrackingRefreshInterval = 1;
+	horizonTrackingResyncAngleD = 0;
+	numThreads = 1;
+	horizonDetector = NULL;
+	horizon = NULL;
+	horizonSource = NULL;
+	blobDetector = NULL;
+	blobEngine = BLOBS_CONTOURS;
+	roiFullFrameInterval = 0;
+	roiMarginPixels = 0;
+	segmentation = SEGMENT_CANNY;
+	colorLut = NULL;
+	adaptiveCannyMinContours = 0;
+	adaptiveCannyMaxContours = 0;
+	changeTileSize = 0;
+	changeThreshold = 0;
+	changeRefreshInterval = 0;
+	blobSource = BLOB_SOURCE_MORPH;
+	circleRadiusFactorMin = 0;
+	circleRadiusFactorMax = 0;
+	circleDetector = NULL;
+	circleRoiUsed = false;
+	blobTracker = NULL;
+	trackingMaxDistance = 0;
+	trackingMaxMissedFrames = 0;
+	pointUndistort = NULL;
+	undistortedCapacity = 0;
+	undistortedCentroid = NULL;
+	frontEnd = NULL;
+	numBlobs = 0;
+	blobCentroid = NULL;
+}
+
+/*
+ * Coarse to fine search (call it before init).
+ * The hough transform and the dynamic programming run at the coarse resolution,
+ * and then a fineFactor times finer hough transform is computed only around the coarse winner.
+ * fineFactor = 1 disables it.
+ */
+void ArchDetector::setCoarseToFine(int fineFactor) {
+	assert(fineFactor >= 1);
+	this->fineFactor = fineFactor;
+}
+
+/*
+ * Sub-bin refinement of the arch lines, see refineArchLines.
+ */
+void ArchDetector::setRefineArchLines(bool refineArchLines) {
+	refineArchLinesEnabled = refineArchLines;
+}
+
+/*
+ * Skipping blob detections (call it before init).
+ * The blob detector runs only every interval frames,
+ * and if alternateHalves, only on the top or the bottom half of the image, alternatively
+ * (the blobs of the other half are kept from the previous detection).
+ * Each half is processed with height/8 rows of the other half, so that a balloon crossing the middle row
+ * is found whole, once, by the half of its centroid (see MorphBlobDetector::findBlobs with ownedRect).
+ * If houghHalfLifeFrames > 0, the hough transform keeps a temporally decayed accumulator,
+ * so that the evidence persists between detections (see LineHoughTransform::setTemporalDecay).
+ * interval = 1, alternateHalves = false, houghHalfLifeFrames = 0 is the normal mode.
+ */
+void ArchDetector::setBlobDetectionInterval(int interval, bool alternateHalves, double houghHalfLifeFrames) {
+	assert(interval >= 1);
+	assert(houghHalfLifeFrames >= 0);
+	blobDetectionInterval = interval;
+	blobDetectionAlternateHalves = alternateHalves;
+	this->houghHalfLifeFrames = houghHalfLifeFrames;
+}
+
+/*
+ * Horizon tracking (call it before init), see HorizonDetector::setTracking.
+ * bandRows = 0 disables it.
+ */
+void ArchDetector::setHorizonTracking(int bandRows, int refreshInterval, double resyncAngleD) {
+	horizonTrackingBandRows = bandRows;
+	horizonTrackingRefreshInterval = refreshInterval;
+	horizonTrackingResyncAngleD = resyncAngleD;
+}
+
+/*
+ * Number of worker threads (call it before init),
+ * see HorizonDetector::setNumThreads and MorphBlobDetector::setNumThreads.
+ */
+void ArchDetector::setNumThreads(int numThreads) {
+	assert(numThreads >= 1);
+	this->numThreads = numThreads;
+}
+
+/*
+ * Takes the horizon from horizonSource (e.g. a TelemetryHorizonSource), instead of computing it from the image
+ * (call it before init). The ArchDetector inits horizonSource, but does not delete it.
+ * Its horizon must be in the coordinates of the undistorted image (it is not undistorted, see setPointUndistortion).
+ */
+void ArchDetector::setHorizonSource(HorizonSource *horizonSource) {
+	this->horizonSource = horizonSource;
+}
+
+/*
+ * Blob detector engine (call it before init), see MorphBlobDetector::setBlobEngine.
+ */
+void ArchDetector::setBlobEngine(int blobEngine) {
+	this->blobEngine = blobEngine;
+}
+
+/*
+ * Blob detector segmentation (call it before init), see MorphBlobDetector::setSegmentation.
+ * The ArchDetector does not delete colorLut.
+ */
+void ArchDetector::setSegmentation(int segmentation, ColorLut *colorLut) {
+	this->segmentation = segmentation;
+	this->colorLut = colorLut;
+}
+
+/*
+ * Adaptive canny thresholds of the blob detector (call it before init), see MorphBlobDetector::setAdaptiveCanny.
+ */
+void ArchDetector::setAdaptiveCanny(int minContours, int maxContours) {
+	adaptiveCannyMinContours = minContours;
+	adaptiveCannyMaxContours = maxContours;
+}
+
+/*
+ * Change detection of the blob detector (call it before init), see MorphBlobDetector::setChangeDetection.
+ * When no tile changed, the horizon of the previous frame is also kept (if it comes from the HorizonDetector).
+ */
+void ArchDetector::setChangeDetection(int tileSize, double threshold, int refreshInterval) {
+	changeTileSize = tileSize;
+	changeThreshold = threshold;
+	changeRefreshInterval = refreshInterval;
+}
+
+/*
+ * Blob source (call it before init).
+ * BLOB_SOURCE_MORPH (default): the blobs of the MorphBlobDetector.
+ * BLOB_SOURCE_CIRCLES: the centers of the circles of the TestCircle detector (circular hough transform),
+ *   instead of the MorphBlobDetector (not created, so the blob detector options are not used).
+ *   The radius of the balloons is searched in [minRadiusFactor, maxRadiusFactor] times the distance
+ *   between the two lines of the arch (rhoDistance * rhoResolution): of the last arch if it is locked
+ *   (see computePredictedRoi), or [rhoDistanceMin, rhoDistanceMax] otherwise.
+ *   If the arch is locked, only the predicted roi is searched.
+ */
+void ArchDetector::setBlobSource(int blobSource, double minRadiusFactor, double maxRadiusFactor) {
+	assert(blobSource == BLOB_SOURCE_MORPH || blobSource == BLOB_SOURCE_CIRCLES);
+	assert(blobSource == BLOB_SOURCE_MORPH || (minRadiusFactor > 0 && minRadiusFactor <= maxRadiusFactor));
+	this->blobSource = blobSource;
+	circleRadiusFactorMin = minRadiusFactor;
+	circleRadiusFactorMax = maxRadiusFactor;
+}
+
+/*
+ * Blob tracking (call it before init).
+ * The blobs of each frame are associated with the blobs of the previous frames (see BlobTracker),
+ * and the hough transform uses the tracked positions: a blob missing in a frame is kept
+ * at its predicted position for maxMissedFrames frames.
+ * maxDistance is the maximum motion of a blob between two frames (pixels). 0 disables it.
+ */
+void ArchDetector::setBlobTracking(double maxDistance, int maxMissedFrames) {
+	assert(maxDistance == 0 || maxDistance >= 1);
+	trackingMaxDistance = maxDistance;
+	trackingMaxMissedFrames = maxMissedFrames;
+}
+
+/*
+ * Point undistortion (call it before init).
+ * Instead of undistorting every frame before the ArchDetector (FilterVideoCapture with cameraUndistort),
+ * the detectors run on the distorted frames, and only their results are undistorted with the lense model
+ * (see CameraUndistort::undistortPoint): the blob centroids (the blobs falling outside the undistorted image
+ * are dropped, as in the undistorted frame) and the sky and ground centers of the horizon detector.
+ * A horizon source (see setHorizonSource) is already in the ideal pinhole image, so it is not undistorted.
+ * So the arch lines are in the coordinates of the undistorted image.
+ * The frame is only warped (cameraUndistort->processImage) for the visualization (see setShowAll).
+ * The ArchDetector inits cameraUndistort, but does not delete it.
+ */
+void ArchDetector::setPointUndistortion(CameraUndistort *cameraUndistort) {
+	pointUndistort = cameraUndistort;
+}
+
+/*
+ * Fused undistortion front end (call it before init).
+ * processImage takes the distorted frames, and runs cameraUndistort->processImage first,
+ * which should be a UNDISTORT_FIXED_POINT with the planes (see CameraUndistort::setFusedOutput):
+ * the blob detector and the horizon detector use its gray and sky channel images
+ * instead of converting the frame again. With the crop or the downscale,
+ * the detectors (and the arch lines) are in the coordinates of the output of cameraUndistort.
+ * Not with the point undistortion (see setPointUndistortion).
+ * The ArchDetector inits cameraUndistort, but does not delete it.
+ */
+void ArchDetector::setFrontEnd(CameraUndistort *cameraUndistort) {
+	frontEnd = cameraUndistort;
+}
+
+/*
+ * Predicted roi (call it before init).
+ * Once the arch is locked (both lines of the last arch have blobs),
+ * the blob detector only processes the bounding box of the band around both arch lines,
+ * dilated by marginPixels (the motion between frames).
+ * The whole frame is processed every fullFrameInterval frames, and when the lock is lost.
+ * fullFrameInterval = 0 disables it.
+ * It takes precedence over the alternating image halves (see setBlobDetectionInterval).
+ */
+void ArchDetector::setPredictedRoi(int fullFrameInterval, int marginPixels) {
+	assert(fullFrameInterval >= 0);
+	assert(marginPixels >= 0);
+	roiFullFrameInterval = fullFrameInterval;
+	roiMarginPixels = marginPixels;
+}
+
+/*
+ * If showAll (default), processImage returns the combined image with the blobs, horizon, canny and hough.
+ * Otherwise it only computes the arch, and returns the source image.
+ */
+void ArchDetector::setShowAll(bool showAll) {
+	this->showAll = showAll;
+	if (blobDetector != NULL)
+		blobDetector->setDrawBlobs(showAll);
 }
 
 void ArchDetector::init(IplImage *current_frame) {
 	cout << "ArchDetector. init" << endl;
+	assert(frontEnd == NULL || pointUndistort == NULL);
+	if (frontEnd != NULL) {
+		//the detectors see the output of the front end
+		frontEnd->init(current_frame);
+		current_frame = frontEnd->processImage(current_frame);
+	}
 	width = current_frame->width;
 	height = current_frame->height;
 
@@ -154,25 +392,67 @@ void ArchDetector::init(IplImage *current_frame) {
 	temp3CImage1     = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
 	temp3CImage2     = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
 
-	blobDetector = new MorphBlobDetector();
-	blobDetector->init(current_frame);
+	//the blob source. only one of blobDetector and circleDetector is created
+	if (blobSource == BLOB_SOURCE_MORPH) {
+		blobDetector = new MorphBlobDetector();
+		blobDetector->setDrawBlobs(showAll);
+		blobDetector->setBlobEngine(blobEngine);
+		blobDetector->setSegmentation(segmentation, colorLut);
+		blobDetector->setAdaptiveCanny(adaptiveCannyMinContours, adaptiveCannyMaxContours);
+		blobDetector->setNumThreads(numThreads);
+		blobDetector->setChangeDetection(changeTileSize, changeThreshold, changeRefreshInterval);
+		if (frontEnd != NULL)
+			blobDetector->setGrayImage(frontEnd->grayImage);
+		blobDetector->init(current_frame);
+	} else {
+		circleDetector = new TestCircle();
+		circleDetector->init(current_frame);
+	}
+	if (trackingMaxDistance > 0)
+		blobTracker = new BlobTracker(width, height, trackingMaxDistance, trackingMaxMissedFrames);
 	
-	horizonDetector = new HorizonDetector();
-	horizonDetector->init(current_frame);
+	if (horizonSource == NULL) {
+		horizonDetector = new HorizonDetector();
+		if (horizonTrackingBandRows > 0)
+			horizonDetector->setTracking(horizonTrackingBandRows, horizonTrackingRefreshInterval, horizonTrackingResyncAngleD);
+		horizonDetector->setNumThreads(numThreads);
+		if (frontEnd != NULL)
+			horizonDetector->setSkyImage(frontEnd->skyImage);
+		horizonSource = horizonDetector;
+	}
+	horizonSource->init(current_frame);
+	if (pointUndistort != NULL)
+		pointUndistort->init(current_frame);
 
 	hough = new LineHoughTransform();
 	hough->init(width, height, thetaResolutionDegrees, rhoResolution);
+	if (houghHalfLifeFrames > 0)
+		hough->setTemporalDecay(houghHalfLifeFrames);
+	frameCount = 0;
+	roiLocked = false;
+	roiFramesSinceFullFrame = 0;
+	predictedRoi = cvRect(0, 0, width, height);
 	tempH = cvCreateImage(cvSize(hough->thetaLen, hough->rhoLen), IPL_DEPTH_8U, 1);
 	//tempH = cvCreateImage(cvSize(18, 91), IPL_DEPTH_8U, 1);
 	HImage  = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
 
+	if (fineFactor > 1) {
+		fineHough = new LineHoughTransform();
+		fineHough->init(width, height, thetaResolutionDegrees / fineFactor, rhoResolution / fineFactor);
+	}
+	fineSecs = 0;
+
 	initDynamicProgrammingTables();
 }
 
 ArchDetector::~ArchDetector() {
 	delete blobDetector;
+	delete circleDetector;
+	delete blobTracker;
+	delete[] undistortedCentroid;
 	delete horizonDetector;
 	delete hough;
+	delete fineHough;
 	delete thetaIdxMin;
 	delete thetaIdxMax;
 	delete rho1IdxMin;
@@ -193,54 +473,136 @@ ArchDetector::~ArchDetector() {
 
 IplImage * ArchDetector::processImage(IplImage *srcImage)
 {
-	bool showAll = true;
-	
+	//UNDISTORTION, with the gray and sky channel planes (see setFrontEnd)
+	if (frontEnd != NULL)
+		srcImage = frontEnd->processImage(srcImage);
+
 	//BLOB DETECTOR
-	blobDetector->findBlobs(srcImage);
+	bool detectBlobs = (frameCount % blobDetectionInterval == 0);
+	bool usePredictedRoi = roiFullFrameInterval > 0 && roiLocked && roiFramesSinceFullFrame < roiFullFrameInterval;
+	bool frameUnchanged = false;
+	if (detectBlobs && circleDetector != NULL) {
+		findCircleBlobs(srcImage);
+	} else if (detectBlobs && blobDetector != NULL) {
+		if (usePredictedRoi) {
+			blobDetector->findBlobs(srcImage, predictedRoi, false);
+			roiFramesSinceFullFrame++;
+		} else if (blobDetectionAlternateHalves) {
+			int half = (frameCount / blobDetectionInterval) % 2;
+			int halfHeight = height / 2;
+			int margin = height / 8;
+			CvRect owned = (half == 0) ? cvRect(0, 0, width, halfHeight) : cvRect(0, halfHeight, width, height - halfHeight);
+			CvRect roi = (half == 0) ? cvRect(0, 0, width, halfHeight + margin) : cvRect(0, halfHeight - margin, width, height - halfHeight + margin);
+			blobDetector->findBlobs(srcImage, roi, owned);
+		} else {
+			blobDetector->findBlobs(srcImage);
+			frameUnchanged = (changeTileSize > 0 && blobDetector->dirtyTileFraction == 0);
+		}
+		if (!usePredictedRoi)
+			roiFramesSinceFullFrame = 0;
+		numBlobs = blobDetector->numBlobs;
+		blobCentroid = blobDetector->blobCentroid;
+	}
+	frameCount++;
 
-	//HORIZON DETECTOR
-	horizonDetector->computeHorizon(srcImage);
+	//BLOB TRACKER
+	if (detectBlobs && blobTracker != NULL) {
+		blobTracker->update(blobCentroid, numBlobs);
+		numBlobs = blobTracker->numTrackedBlobs;
+		blobCentroid = blobTracker->trackedCentroid;
+	}
+	if (detectBlobs && pointUndistort != NULL)
+		undistortBlobs();
+
+	//HORIZON DETECTOR (or telemetry)
+	if (!(frameUnchanged && horizonSource == horizonDetector && horizon != NULL)) {
+		horizon = horizonSource->getHorizon(srcImage);
+		if (pointUndistort != NULL && horizonSource == horizonDetector) {
+			undistortHorizon(horizon);
+			horizon = &undistortedHorizon;
+		}
+	}
 
 	//HOUGH TRANSFORM
-	hough->computeHough(blobDetector->blobCentroid, blobDetector->numBlobs);
+	double timeStart = getTimeSecs();
+	if (detectBlobs)
+		hough->computeHough(blobCentroid, numBlobs);
+	else
+		hough->skipFrame();
 	cvMinS(hough->H, 3, hough->H);
 
 	//DYNAMIC PROGRAMMING
 	computeNewAccumulatedCost();
+	coarseSecs = getTimeSecs() - timeStart;
+
+	archHough = hough;
+	archThetaIdx = currentStateDesc->thetaIdx;
+	archRho1Idx = currentStateDesc->rho1Idx;
+	archRho2Idx = currentStateDesc->rho1Idx + currentStateDesc->rhoDistance;
+	archTheta = theta[archThetaIdx];
+	archRho1 = rho[archRho1Idx];
+	archRho2 = rho[archRho2Idx];
+
+	//COARSE TO FINE
+	if (fineFactor > 1) {
+		timeStart = getTimeSecs();
+		computeFineState();
+		fineSecs = getTimeSecs() - timeStart;
+	}
+
+	//SUB-BIN REFINEMENT
+	if (refineArchLinesEnabled)
+		refineArchLines();
+
+	//PREDICTED ROI, for the next frame
+	if (roiFullFrameInterval > 0 || circleDetector != NULL)
+		computePredictedRoi();
 
 	if (showAll) {
 		//COMBINE IMAGES
-		//mixed image. draw blobs
-		cvCopy(srcImage, mixedImage);
-		cvCvtColor(blobDetector->blobsImage, temp3CImage1, CV_GRAY2BGR);
-		cvCopy(temp3CImage1, mixedImage, blobDetector->blobsImage);
+		//mixed image. draw blobs (only in the distorted frame, see setPointUndistortion)
+		if (pointUndistort != NULL) {
+			cvCopy(pointUndistort->processImage(srcImage), mixedImage);
+		} else if (blobDetector != NULL) {
+			cvCopy(srcImage, mixedImage);
+			cvCvtColor(blobDetector->blobsImage, temp3CImage1, CV_GRAY2BGR);
+			cvCopy(temp3CImage1, mixedImage, blobDetector->blobsImage);
+		} else {
+			//the circles found (the centroids may be the tracked ones)
+			cvCopy(srcImage, mixedImage);
+			for (int i = 0; i < circleDetector->numBlobs; i++)
+				cvCircle(mixedImage, cvPoint(circleDetector->blobCentroid[i][0], circleDetector->blobCentroid[i][1]), circleDetector->blobRadius[i], CV_WHITE, 1);
+		}
 
 		//mixed image. draw horizon
-		cvLine(mixedImage, cvPoint(0, height - (int)horizonDetector->horizon.b), cvPoint(width, height - (int)horizonDetector->horizon.b - (int)(horizonDetector->horizon.a * width)), CV_GREEN, 2);
+		cvLine(mixedImage, cvPoint(0, height - (int)horizon->b), cvPoint(width, height - (int)horizon->b - (int)(horizon->a * width)), CV_GREEN, 2);
 
 		//mixed image. draw arch
-		double thisRho1 = rho[currentStateDesc->rho1Idx];
-		double thisRho2 = rho[currentStateDesc->rho1Idx + currentStateDesc->rhoDistance];
-		int thisThetaIdx = currentStateDesc->thetaIdx;
-		if (sint[thisThetaIdx] != 0) {
-			cvLine(mixedImage, cvPoint(0, (int)(thisRho1/sint[thisThetaIdx])), cvPoint(width-1, (int)((thisRho1 - (width-1)*cost[thisThetaIdx])/sint[thisThetaIdx])), CV_RED, 2);
-			cvLine(mixedImage, cvPoint(0, (int)(thisRho2/sint[thisThetaIdx])), cvPoint(width-1, (int)((thisRho2 - (width-1)*cost[thisThetaIdx])/sint[thisThetaIdx])), CV_BLUE, 2);
-		} else {
-			cvLine(mixedImage, cvPoint((int)thisRho1, 0), cvPoint((int)thisRho1, height-1), CV_RED, 2);
-			cvLine(mixedImage, cvPoint((int)thisRho2, 0), cvPoint((int)thisRho2, height-1), CV_BLUE, 2);
-		}
+		drawLine(mixedImage, archTheta, archRho1, CV_RED);
+		drawLine(mixedImage, archTheta, archRho2, CV_BLUE);
 
 		//mixed image. draw blob centrois
-		for (int i = 0; i < blobDetector->numBlobs; i++)
-			drawSymbol(mixedImage, 1, blobDetector->blobCentroid[i][0], blobDetector->blobCentroid[i][1], CV_GREEN);
+		for (int i = 0; i < numBlobs; i++) {
+			bool predicted = (blobTracker != NULL && blobTracker->trackedPredicted[i]);
+			drawSymbol(mixedImage, 1, blobCentroid[i][0], blobCentroid[i][1], predicted ? CV_BLUE : CV_GREEN);
+		}
+
+		//mixed image. draw the roi of the blob detector
+		if ((usePredictedRoi || (circleDetector != NULL && circleRoiUsed)) && pointUndistort == NULL)
+			cvRectangle(mixedImage, cvPoint(predictedRoi.x, predictedRoi.y), cvPoint(predictedRoi.x + predictedRoi.width - 1, predictedRoi.y + predictedRoi.height - 1), CV_WHITE, 1);
 
 
 		//horizon
-		IplImage *horizonImage = horizonDetector->showImage();
+		IplImage *horizonImage = horizonSource->showImage();
 
-		//canny
+		//canny (or the gray image of the circle detector)
 		IplImage *canny3CImage = temp3CImage1;
-		cvCvtColor(blobDetector->cannyImage, canny3CImage, CV_GRAY2BGR);
+		if (blobDetector != NULL) {
+			cvCvtColor(blobDetector->cannyImage, canny3CImage, CV_GRAY2BGR);
+			blobDetector->drawInfo(canny3CImage);
+		} else {
+			cvCvtColor(circleDetector->gray_image, canny3CImage, CV_GRAY2BGR);
+		}
 
 		//hough
 		cvConvertScale(hough->H, tempH, 255/3, 0);
@@ -257,6 +619,151 @@ IplImage * ArchDetector::processImage(IplImage *srcImage)
 	}
 }
 
+//draws the line x*cos(theta) + y*sin(theta) = rho
+void ArchDetector::drawLine(IplImage *image, double theta, double rho, CvScalar color) {
+	double sinT = sin(theta);
+	double cosT = cos(theta);
+	if (fabs(sinT) > fabs(cosT)) {
+		cvLine(image, cvPoint(0, (int)(rho/sinT)), cvPoint(width-1, (int)((rho - (width-1)*cosT)/sinT)), color, 2);
+	} else {
+		cvLine(image, cvPoint((int)(rho/cosT), 0), cvPoint((int)((rho - (height-1)*sinT)/cosT), height-1), color, 2);
+	}
+}
+
+/*
+ * The arch is locked if both lines of the arch have blobs (votes in the hough transform).
+ * Then, predictedRoi is the bounding box of both lines inside the image, dilated by roiMarginPixels.
+ */
+void ArchDetector::computePredictedRoi() {
+	roiLocked = archHough->getHAt(archThetaIdx, archRho1Idx) > 0 && archHough->getHAt(archThetaIdx, archRho2Idx) > 0;
+	if (!roiLocked)
+		return;
+
+	double sinT = sin(archTheta);
+	double cosT = cos(archTheta);
+	double minX = width, maxX = 0, minY = height, maxY = 0;
+	double archRho[2] = {archRho1, archRho2};
+	for (int line = 0; line < 2; line++) {
+		//the end points of the line, at the image borders (as in drawLine)
+		double x1, y1, x2, y2;
+		if (fabs(sinT) > fabs(cosT)) {
+			x1 = 0;         y1 = archRho[line] / sinT;
+			x2 = width-1;   y2 = (archRho[line] - (width-1)*cosT) / sinT;
+		} else {
+			x1 = archRho[line] / cosT;                   y1 = 0;
+			x2 = (archRho[line] - (height-1)*sinT) / cosT;  y2 = height-1;
+		}
+		minX = min(minX, min(x1, x2));  maxX = max(maxX, max(x1, x2));
+		minY = min(minY, min(y1, y2));  maxY = max(maxY, max(y1, y2));
+	}
+	if (pointUndistort != NULL) {
+		//the box is in the undistorted image, and the blob detector runs on the distorted frame:
+		//the bounding box of the distorted border of the box (inside the image)
+		double boxX0 = max(minX, 0.), boxX1 = min(maxX, width - 1.);
+		double boxY0 = max(minY, 0.), boxY1 = min(maxY, height - 1.);
+		if (boxX0 <= boxX1 && boxY0 <= boxY1) {
+			const int samplesPerSide = 8;
+			minX = width; maxX = 0; minY = height; maxY = 0;
+			for (int i = 0; i <= samplesPerSide; i++) {
+				double t = (double)i / samplesPerSide;
+				double borderX[4] = {boxX0 + t*(boxX1 - boxX0), boxX0 + t*(boxX1 - boxX0), boxX0, boxX1};
+				double borderY[4] = {boxY0, boxY1, boxY0 + t*(boxY1 - boxY0), boxY0 + t*(boxY1 - boxY0)};
+				for (int side = 0; side < 4; side++) {
+					double x, y;
+					pointUndistort->distortPoint(borderX[side], borderY[side], x, y);
+					minX = min(minX, x);  maxX = max(maxX, x);
+					minY = min(minY, y);  maxY = max(maxY, y);
+				}
+			}
+		}
+	}
+	int x0 = Max(0, (int)floor(minX) - roiMarginPixels);
+	int y0 = Max(0, (int)floor(minY) - roiMarginPixels);
+	int x1 = Min(width - 1, (int)ceil(maxX) + roiMarginPixels);
+	int y1 = Min(height - 1, (int)ceil(maxY) + roiMarginPixels);
+	if (x1 < x0 || y1 < y0) {
+		roiLocked = false;    //the arch is outside the image
+		return;
+	}
+	predictedRoi = cvRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+/*
+ * The blob centroids of the current frame in the undistorted image (see setPointUndistortion).
+ */
+void ArchDetector::undistortBlobs() {
+	if (numBlobs > undistortedCapacity) {
+		delete[] undistortedCentroid;
+		undistortedCapacity = Max(numBlobs, 2 * undistortedCapacity);
+		undistortedCentroid = new int[undistortedCapacity][2];
+	}
+	int numUndistorted = 0;
+	for (int i = 0; i < numBlobs; i++) {
+		double x, y;
+		if (!pointUndistort->undistortPoint(blobCentroid[i][0], blobCentroid[i][1], x, y))
+			continue;
+		int ux = cvRound(x), uy = cvRound(y);
+		if (ux < 0 || ux >= width || uy < 0 || uy >= height)
+			continue;
+		undistortedCentroid[numUndistorted][0] = ux;
+		undistortedCentroid[numUndistorted][1] = uy;
+		numUndistorted++;
+	}
+	numBlobs = numUndistorted;
+	blobCentroid = undistortedCentroid;
+}
+
+/*
+ * sourceHorizon in the undistorted image (see setPointUndistortion): the sky and ground centers,
+ * and the point x0, y0, are undistorted, and the line is computed from them as in the HorizonDetector.
+ * If one of them cannot be undistorted (an image corner), the horizon is kept as it is.
+ */
+void ArchDetector::undistortHorizon(Horizon *sourceHorizon) {
+	Horizon &h = undistortedHorizon;
+	h = *sourceHorizon;
+	double x0, y0;
+	if (!pointUndistort->undistortPoint(sourceHorizon->skyX, sourceHorizon->skyY, h.skyX, h.skyY)
+	    || !pointUndistort->undistortPoint(sourceHorizon->groundX, sourceHorizon->groundY, h.groundX, h.groundY)
+	    || !pointUndistort->undistortPoint(sourceHorizon->x0, sourceHorizon->y0, x0, y0)) {
+		h = *sourceHorizon;
+		return;
+	}
+	h.x0 = (int)x0;
+	h.y0 = (int)y0;
+	h.angleR = CV_PI/2 + atan(-(h.groundY - h.skyY) / (h.groundX - h.skyX));
+	h.angleD = h.angleR * 180 / CV_PI;
+	h.a = tan(h.angleR);
+	h.b = (height - h.y0) - h.a*h.x0;
+}
+
+/*
+ * The blobs of the current frame from the circle detector (see setBlobSource).
+ */
+void ArchDetector::findCircleBlobs(IplImage *srcImage) {
+	double archWidthMin, archWidthMax;   //pixels
+	if (roiLocked) {
+		archWidthMin = archWidthMax = fabs(archRho2 - archRho1);
+	} else {
+		archWidthMin = rhoDistanceMin * rhoResolution;
+		archWidthMax = rhoDistanceMax * rhoResolution;
+	}
+	int minRadius = Max(1, (int)floor(circleRadiusFactorMin * archWidthMin));
+	int maxRadius = Max(minRadius, (int)ceil(circleRadiusFactorMax * archWidthMax));
+	circleRoiUsed = roiLocked;
+	CvRect roi = cvRect(0, 0, width, height);
+	if (roiLocked) {
+		//the balloons are centered on the lines, so the whole balloon is inside roi dilated by its radius
+		int x0 = Max(0, predictedRoi.x - maxRadius);
+		int y0 = Max(0, predictedRoi.y - maxRadius);
+		int x1 = Min(width, predictedRoi.x + predictedRoi.width + maxRadius);
+		int y1 = Min(height, predictedRoi.y + predictedRoi.height + maxRadius);
+		roi = cvRect(x0, y0, x1 - x0, y1 - y0);
+	}
+	circleDetector->findCircles(srcImage, roi, minRadius, maxRadius);
+	numBlobs = circleDetector->numBlobs;
+	blobCentroid = circleDetector->blobCentroid;
+}
+
 void ArchDetector::initDynamicProgrammingTables() {
 	//given that we are looking for lines of angle T, we actually look for lines
 	//at angle T-AngleMargin to T+AngleMargin in order to accomdate the noise of the horiton detector
@@ -371,7 +878,7 @@ void ArchDetector::initDynamicProgrammingTables() {
 void ArchDetector::computeNewAccumulatedCost() {
 
 	//find the thetaCenter, according to the horizon
-	double thetaCenter = mod(horizonDetector->horizon.angleR + CV_PI/2, CV_PI);
+	double thetaCenter = mod(horizon->angleR + CV_PI/2, CV_PI);
 	thetaCenter = CV_PI/2 - thetaCenter; //angle reference in the hough transform
 	int thetaCenterIdx = (int) ((thetaCenter - theta[0]) * (thetaLen -1) / (theta[thetaLen-1] - theta[0]));
 
@@ -444,6 +951,124 @@ void ArchDetector::computeNewAccumulatedCost() {
 }
 
 
+/*
+ * COARSE TO FINE
+ * Once the dynamic programming has selected the coarse state (currentStateDesc),
+ * compute the fine hough transform only for the angles around the coarse angle,
+ * and look for the best two lines in a small window around the coarse winner:
+ * +- fineFactor fine bins (so, +- one coarse bin) for theta, rho1 and rho2.
+ * There is no dynamic programming at this level, the coarse level already did the tracking.
+ */
+void ArchDetector::computeFineState() {
+	int thetaCenterIdx = fineHough->getThetaIdxOf(theta[currentStateDesc->thetaIdx]);
+	int rho1CenterIdx = fineHough->getRhoIdxOf(rho[currentStateDesc->rho1Idx]);
+	int rho2CenterIdx = fineHough->getRhoIdxOf(rho[currentStateDesc->rho1Idx + currentStateDesc->rhoDistance]);
+
+	int fineThetaIdxMin = Max(0, thetaCenterIdx - fineFactor);
+	int fineThetaIdxMax = Min(fineHough->thetaLen-1, thetaCenterIdx + fineFactor);
+	int fineRho1IdxMin = Max(0, rho1CenterIdx - fineFactor);
+	int fineRho1IdxMax = Min(fineHough->rhoLen-1, rho1CenterIdx + fineFactor);
+	int fineRho2IdxMin = Max(0, rho2CenterIdx - fineFactor);
+	int fineRho2IdxMax = Min(fineHough->rhoLen-1, rho2CenterIdx + fineFactor);
+
+	fineHough->computeHough(blobCentroid, numBlobs, fineThetaIdxMin, fineThetaIdxMax);
+
+	int maxHits = -1, minDistance = 0;
+	int bestThetaIdx = thetaCenterIdx, bestRho1Idx = rho1CenterIdx, bestRho2Idx = rho2CenterIdx;
+	fineNumStates = 0;
+	for (int thetaIdx = fineThetaIdxMin; thetaIdx <= fineThetaIdxMax; thetaIdx++) {
+		for (int rho1Idx = fineRho1IdxMin; rho1Idx <= fineRho1IdxMax; rho1Idx++) {
+			int hits1 = Min(3, fineHough->getHAt(thetaIdx, rho1Idx));
+			for (int rho2Idx = Max(fineRho2IdxMin, rho1Idx + 1); rho2Idx <= fineRho2IdxMax; rho2Idx++) {
+				int hits = hits1 + Min(3, fineHough->getHAt(thetaIdx, rho2Idx));
+				//on a tie, keep the state closest to the coarse winner
+				int distance = absminus(thetaIdx, thetaCenterIdx) + absminus(rho1Idx, rho1CenterIdx) + absminus(rho2Idx, rho2CenterIdx);
+				if (hits > maxHits || (hits == maxHits && distance < minDistance)) {
+					maxHits = hits;
+					minDistance = distance;
+					bestThetaIdx = thetaIdx;
+					bestRho1Idx = rho1Idx;
+					bestRho2Idx = rho2Idx;
+				}
+				fineNumStates++;
+			}
+		}
+	}
+
+	archHough = fineHough;
+	archThetaIdx = bestThetaIdx;
+	archRho1Idx = bestRho1Idx;
+	archRho2Idx = bestRho2Idx;
+	archTheta = fineHough->theta[bestThetaIdx];
+	archRho1 = fineHough->rho[bestRho1Idx];
+	archRho2 = fineHough->rho[bestRho2Idx];
+}
+
+
+/*
+ * SUB-BIN REFINEMENT
+ * The arch lines snap to the hough grid (thetaResolutionDegrees, rhoResolution).
+ * Take the blobs voting for the two winning cells (archThetaIdx, archRho1Idx) and (archThetaIdx, archRho2Idx),
+ * and fit two parallel lines jointly by least squares:
+ *   minimize sum (x*cos(theta) + y*sin(theta) - rhoK)^2, for the blobs of the line K = 1, 2.
+ * For a given theta, rhoK is the projection of the mean of the blobs of the line K,
+ * so theta is the normal of the pooled scatter matrix of the blobs, each one centered at the mean of its line.
+ *
+ * The result is kept only if both lines have blobs, at least one line has two blobs,
+ * and the refined angle stays within one hough bin of the winning cell.
+ */
+void ArchDetector::refineArchLines() {
+	int n1 = 0, n2 = 0;
+	double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	for (int i = 0; i < numBlobs; i++) {
+		int x = blobCentroid[i][0];
+		int y = blobCentroid[i][1];
+		int rhoIdx = archHough->getRhoIdx(archThetaIdx, x, y);
+		if (rhoIdx == archRho1Idx) {
+			x1 += x; y1 += y; n1++;
+		} else if (rhoIdx == archRho2Idx) {
+			x2 += x; y2 += y; n2++;
+		}
+	}
+	if (n1 == 0 || n2 == 0 || n1 + n2 < 3)
+		return;
+	x1 /= n1; y1 /= n1;
+	x2 /= n2; y2 /= n2;
+
+	double sxx = 0, sxy = 0, syy = 0;
+	for (int i = 0; i < numBlobs; i++) {
+		int x = blobCentroid[i][0];
+		int y = blobCentroid[i][1];
+		int rhoIdx = archHough->getRhoIdx(archThetaIdx, x, y);
+		double dx, dy;
+		if (rhoIdx == archRho1Idx) {
+			dx = x - x1; dy = y - y1;
+		} else if (rhoIdx == archRho2Idx) {
+			dx = x - x2; dy = y - y2;
+		} else {
+			continue;
+		}
+		sxx += dx*dx; sxy += dx*dy; syy += dy*dy;
+	}
+	if (sxx + syy == 0)
+		return;
+
+	//direction of the lines = main axis of the scatter matrix. theta is its normal
+	double refinedTheta = 0.5 * atan2(2*sxy, sxx - syy) + CV_PI/2;
+	//(theta, rho) and (theta - pi, -rho) are the same line. take the one closest to the grid angle
+	refinedTheta = archTheta + mod(refinedTheta - archTheta + CV_PI/2, CV_PI) - CV_PI/2;
+	double thetaBin = archHough->theta[1] - archHough->theta[0];
+	if (fabs(refinedTheta - archTheta) > thetaBin)
+		return;
+
+	double cosT = cos(refinedTheta);
+	double sinT = sin(refinedTheta);
+	archTheta = refinedTheta;
+	archRho1 = x1*cosT + y1*sinT;
+	archRho2 = x2*cosT + y2*sinT;
+}
+
+
 int ArchDetector::computeThisNewAccumulatedCost(int *previousAccumulatedCost, int newStateCost, int newThetaIdx, int newRho1Idx, int newRhoDistance) {
 	int minCost = 999999; //TODO: prevent accumulatedCost0/1 to overflow...
 	
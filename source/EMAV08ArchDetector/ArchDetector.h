@@ -43,22 +43,61 @@
 #include "HorizonDetector.h"
 #include "VideoCapture.h"
 
+class TestCircle;
+class BlobTracker;
+
+enum { BLOB_SOURCE_MORPH, BLOB_SOURCE_CIRCLES };
+
 class ArchDetector : public ImageProcessor {
 public:
 	ArchDetector();
 	ArchDetector(int thetaResolutionDegrees, int rhoResolution, int angleDegreesMargin, int rhoDistanceMin, int rhoDistanceMax, bool allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage);
+	void setCoarseToFine(int fineFactor);
+	void setRefineArchLines(bool refineArchLines);
+	void setBlobDetectionInterval(int interval, bool alternateHalves, double houghHalfLifeFrames);
+	void setHorizonTracking(int bandRows, int refreshInterval, double resyncAngleD);
+	void setNumThreads(int numThreads);
+	void setHorizonSource(HorizonSource *horizonSource);
+	void setBlobEngine(int blobEngine);
+	void setSegmentation(int segmentation, ColorLut *colorLut);
+	void setAdaptiveCanny(int minContours, int maxContours);
+	void setChangeDetection(int tileSize, double threshold, int refreshInterval);
+	void setBlobSource(int blobSource, double minRadiusFactor, double maxRadiusFactor);
+	void setBlobTracking(double maxDistance, int maxMissedFrames);
+	void setPredictedRoi(int fullFrameInterval, int marginPixels);
+	void setPointUndistortion(CameraUndistort *cameraUndistort);
+	void setFrontEnd(CameraUndistort *cameraUndistort);
+	void setShowAll(bool showAll);
 	void init(IplImage *current_frame);
 	IplImage * processImage(IplImage *srcImage);
+	~ArchDetector();
+
+	//the detected arch: x*cos(archTheta) + y*sin(archTheta) = archRho1 (and archRho2)
+	double archTheta, archRho1, archRho2;
+	double coarseSecs, fineSecs;  //cost of each level, last frame
 
 
 private:
-	~ArchDetector();
+	void setDefaults();
 	void initDynamicProgrammingTables();
 	void computeNewAccumulatedCost();
 	int  computeThisNewAccumulatedCost(int *previousAccumulatedCost, int newStateCost, int newThetaIdx, int newRho1Idx, int newRhoDistance);
+	void computeFineState();
+	void refineArchLines();
+	void drawLine(IplImage *image, double theta, double rho, CvScalar color);
+	void computePredictedRoi();
+	void findCircleBlobs(IplImage *srcImage);
+	void undistortBlobs();
+	void undistortHorizon(Horizon *sourceHorizon);
 
-	MorphBlobDetector *blobDetector;
-	HorizonDetector *horizonDetector;
+	MorphBlobDetector *blobDetector;    //NULL if the blobs come from the circle detector
+	TestCircle *circleDetector;         //NULL if the blobs come from the blob detector
+	BlobTracker *blobTracker;           //NULL if the blobs are not tracked
+	int numBlobs;                       //blobs of the current frame, from blobDetector or circleDetector (or blobTracker)
+	int (*blobCentroid)[2];
+	HorizonDetector *horizonDetector;   //NULL if the horizon comes from another source
+	HorizonSource *horizonSource;
+	Horizon *horizon;                   //horizon of the current frame
 
 	double thetaResolutionDegrees, rhoResolution;
 	int angleDegreesMargin;
@@ -66,6 +105,60 @@ private:
 	bool allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage;
 	
 	LineHoughTransform *hough;
+	int fineFactor;                  //1 = no coarse to fine search
+	LineHoughTransform *fineHough;
+	int fineNumStates;
+	bool refineArchLinesEnabled;
+	bool showAll;
+
+	//blob detection only every blobDetectionInterval frames (see setBlobDetectionInterval)
+	int blobDetectionInterval;
+	bool blobDetectionAlternateHalves;
+	double houghHalfLifeFrames;   //0 = no temporal decay
+	int frameCount;
+
+	//horizon tracking (see HorizonDetector::setTracking)
+	int horizonTrackingBandRows;
+	int horizonTrackingRefreshInterval;
+	double horizonTrackingResyncAngleD;
+
+	int numThreads;
+	int blobEngine;
+	int segmentation;
+	ColorLut *colorLut;   //not owned
+	int adaptiveCannyMinContours, adaptiveCannyMaxContours;
+	int changeTileSize;          //0 = disabled
+	double changeThreshold;
+	int changeRefreshInterval;
+
+	//blob source (see setBlobSource)
+	int blobSource;
+	double circleRadiusFactorMin, circleRadiusFactorMax;
+	bool circleRoiUsed;
+
+	//blob tracking (see setBlobTracking)
+	double trackingMaxDistance;   //0 = disabled
+	int trackingMaxMissedFrames;
+
+	//point undistortion (see setPointUndistortion)
+	CameraUndistort *pointUndistort;   //not owned. NULL = the frames are used as they are
+	int undistortedCapacity;
+	int (*undistortedCentroid)[2];
+	Horizon undistortedHorizon;
+
+	//fused undistortion front end (see setFrontEnd)
+	CameraUndistort *frontEnd;   //not owned. NULL = the frames are used as they are
+
+	//predicted roi for the blob detector (see setPredictedRoi)
+	int roiFullFrameInterval;     //0 = disabled
+	int roiMarginPixels;
+	bool roiLocked;
+	int roiFramesSinceFullFrame;
+	CvRect predictedRoi;
+
+	//the winning cells, in the hough transform of the last level (coarse or fine)
+	LineHoughTransform *archHough;
+	int archThetaIdx, archRho1Idx, archRho2Idx;
 	double *rho, *theta;
 	int rhoLen, thetaLen;
 	double *sint, *cost;
@@ -0,0 +1,1468 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * BENCHMARKS
+ * Measure the cost of some stages of the detectors,
+ * and check that the faster implementations give the same result as the original ones.
+ *
+ * EMAV08ArchDetector -bench <id>
+ * Some benchmarks use synthetic data, others need a video (-if).
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdlib.h>
+using namespace std;
+
+#include "util.h"
+#include "Benchmark.h"
+#include "HoughTransform.h"
+#include "ArchDetector.h"
+#include "HorizonDetector.h"
+#include "Parallel.h"
+#include "TelemetryHorizonSource.h"
+#include "MorphBlobDetector.h"
+#include "ColorLut.h"
+#include "FillErodeBlobDetector.h"
+#include "TileChangeDetector.h"
+#include "BlobTracker.h"
+#include "SobelEdgeDetector.h"
+#include "CameraUndistort.h"
+
+
+void runBenchmark(const char *benchmarkId, VideoCapture *vc) {
+	if (strcmp(benchmarkId, "hough") == 0) {
+		benchmarkHough();
+	} else if (strcmp(benchmarkId, "blobinterval") == 0) {
+		benchmarkBlobInterval(vc);
+	} else if (strcmp(benchmarkId, "horizon") == 0) {
+		benchmarkHorizon();
+	} else if (strcmp(benchmarkId, "horizontracking") == 0) {
+		benchmarkHorizonTracking(320, 240);
+		benchmarkHorizonTracking(640, 480);
+	} else if (strcmp(benchmarkId, "horizonthreads") == 0) {
+		benchmarkHorizonThreads(640, 480);
+		benchmarkHorizonThreads(1920, 1080);
+	} else if (strcmp(benchmarkId, "predictedroi") == 0) {
+		benchmarkPredictedRoi(vc);
+	} else if (strcmp(benchmarkId, "circles") == 0) {
+		benchmarkCircleBlobs(vc);
+	} else if (strcmp(benchmarkId, "blobengine") == 0) {
+		benchmarkBlobEngine(vc);
+	} else if (strcmp(benchmarkId, "tracker") == 0) {
+		benchmarkBlobTracker(20);
+		benchmarkBlobTracker(200);
+		benchmarkBlobTracker(2000);
+	} else if (strcmp(benchmarkId, "sobel") == 0) {
+		benchmarkSobelEdges(320, 240);
+		benchmarkSobelEdges(640, 480);
+		if (vc != NULL)
+			benchmarkSobelVsCanny(vc);
+	} else if (strcmp(benchmarkId, "undistort") == 0) {
+		benchmarkUndistort(640, 480);
+	} else if (strcmp(benchmarkId, "fused") == 0) {
+		benchmarkFusedUndistort(640, 480);
+	} else if (strcmp(benchmarkId, "tilechange") == 0) {
+		benchmarkTileChange(vc);
+	} else if (strcmp(benchmarkId, "blobthreads") == 0) {
+		benchmarkBlobThreads(vc);
+	} else if (strcmp(benchmarkId, "fillerode") == 0) {
+		benchmarkFillErode(320, 240);
+		benchmarkFillErode(640, 480);
+	} else if (strcmp(benchmarkId, "adaptivecanny") == 0) {
+		benchmarkAdaptiveCanny(vc);
+	} else if (strcmp(benchmarkId, "colorlut") == 0) {
+		benchmarkColorLut(320, 240);
+		benchmarkColorLut(640, 480);
+	} else if (strcmp(benchmarkId, "telemetry") == 0) {
+		benchmarkTelemetryHorizon(320, 240);
+	} else {
+		throw "Unknown benchmark id";
+	}
+}
+
+
+//the video benchmarks use the first frames of the video, with random access
+static int getBenchmarkNumFrames(VideoCapture *vc) {
+	if (vc == NULL || !vc->allowsRandomAccess())
+		throw "This benchmark needs a video file (-if).";
+	return Min(vc->getNumFrames(), 300);
+}
+
+//the arch of each frame, with the reference configuration
+struct ArchBenchmarkReference {
+	ArchBenchmarkReference(int numFrames) {
+		theta = new double[numFrames];
+		rho1 = new double[numFrames];
+		rho2 = new double[numFrames];
+	}
+	~ArchBenchmarkReference() {
+		delete[] theta;
+		delete[] rho1;
+		delete[] rho2;
+	}
+	double *theta, *rho1, *rho2;
+};
+
+/*
+ * Runs archDetector (without visualization) on the first numFrames frames,
+ * and prints the throughput of processImage, and the mean error of the arch lines with respect to reference.
+ * If isReference, it fills reference instead.
+ */
+static void runArchBenchmark(ArchDetector *archDetector, VideoCapture *vc, int numFrames, ArchBenchmarkReference &reference, bool isReference) {
+	archDetector->setShowAll(false);
+
+	double secs = 0;
+	double errorTheta = 0, errorRho1 = 0, errorRho2 = 0;
+	for (int frame = 0; frame < numFrames; frame++) {
+		IplImage *image = vc->cvQueryFrame(frame);
+		if (frame == 0)
+			archDetector->init(image);
+
+		double timeStart = getTimeSecs();
+		archDetector->processImage(image);
+		secs += getTimeSecs() - timeStart;
+
+		if (isReference) {
+			reference.theta[frame] = archDetector->archTheta;
+			reference.rho1[frame] = archDetector->archRho1;
+			reference.rho2[frame] = archDetector->archRho2;
+		} else {
+			errorTheta += fabs(archDetector->archTheta - reference.theta[frame]);
+			errorRho1 += fabs(archDetector->archRho1 - reference.rho1[frame]);
+			errorRho2 += fabs(archDetector->archRho2 - reference.rho2[frame]);
+		}
+	}
+
+	cout << "fps: " << numFrames / secs << ", "
+	     << "mean error. theta: " << errorTheta / numFrames * 180 / CV_PI << " degrees, "
+	     << "rho1: " << errorRho1 / numFrames << ", rho2: " << errorRho2 / numFrames << endl;
+}
+
+
+
+/*
+ * LineHoughTransform (geometry at runtime) vs LineHoughTransformT (geometry at compile time),
+ * thetaResolutionDegrees = 10, rhoResolution = 10.
+ */
+template <class HT>
+void benchmarkHoughSize(const char *name, int width, int height, int numPoints, int iterations) {
+	int (*points)[2] = new int[numPoints][2];
+	srand(1);
+	for (int i = 0; i < numPoints; i++) {
+		points[i][0] = rand() % width;
+		points[i][1] = rand() % height;
+	}
+
+	LineHoughTransform runtimeHough;
+	runtimeHough.init(width, height, 10, 10);
+	HT *templateHough = new HT();
+	assert(runtimeHough.thetaLen == HT::ThetaLen);
+	assert(runtimeHough.rhoLen == HT::RhoLen);
+
+	double timeStart = getTimeSecs();
+	for (int i = 0; i < iterations; i++)
+		runtimeHough.computeHough(points, numPoints);
+	double runtimeSecs = getTimeSecs() - timeStart;
+
+	timeStart = getTimeSecs();
+	for (int i = 0; i < iterations; i++)
+		templateHough->computeHough(points, numPoints);
+	double templateSecs = getTimeSecs() - timeStart;
+
+	int differentCells = 0;
+	for (int thetaIdx = 0; thetaIdx < HT::ThetaLen; thetaIdx++)
+		for (int rhoIdx = 0; rhoIdx < HT::RhoLen; rhoIdx++)
+			if (runtimeHough.getHAt(thetaIdx, rhoIdx) != templateHough->getHAt(thetaIdx, rhoIdx))
+				differentCells++;
+
+	cout << name << " " << width << "x" << height << ", " << numPoints << " points. "
+	     << "LineHoughTransform: " << runtimeSecs * 1000000 / iterations << " us, "
+	     << "LineHoughTransformT: " << templateSecs * 1000000 / iterations << " us, "
+	     << "speedup: " << runtimeSecs / templateSecs << ", "
+	     << "different cells: " << differentCells << endl;
+
+	delete templateHough;
+	delete[] points;
+}
+
+void benchmarkHough() {
+	const int iterations = 20000;
+	for (int numPoints = 10; numPoints <= 100; numPoints *= 10) {
+		benchmarkHoughSize< LineHoughTransformT<320, 240, 10, 10> >("int  ", 320, 240, numPoints, iterations);
+		benchmarkHoughSize< LineHoughTransformT<320, 240, 10, 10, uchar> >("uchar", 320, 240, numPoints, iterations);
+		benchmarkHoughSize< LineHoughTransformT<640, 480, 10, 10> >("int  ", 640, 480, numPoints, iterations);
+		benchmarkHoughSize< LineHoughTransformT<640, 480, 10, 10, uchar> >("uchar", 640, 480, numPoints, iterations);
+	}
+}
+
+
+
+/*
+ * ArchDetector running the blob detector only every N frames
+ * (optionally on alternating image halves), with a temporally decayed hough transform (half-life = N frames).
+ * Throughput of processImage (without visualization),
+ * and mean error of the arch lines with respect to running the blob detector every frame.
+ */
+void benchmarkBlobInterval(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int numConfigs = 6;
+	int interval[numConfigs]        = {1,     2,     3,     4,     1,    2};
+	bool alternateHalves[numConfigs] = {false, false, false, false, true, true};
+
+	ArchBenchmarkReference reference(numFrames);
+	for (int config = 0; config < numConfigs; config++) {
+		ArchDetector *archDetector = new ArchDetector();
+		double halfLife = (interval[config] > 1 || alternateHalves[config]) ? interval[config] : 0;
+		archDetector->setBlobDetectionInterval(interval[config], alternateHalves[config], halfLife);
+
+		cout << "BENCHMARK. blob detection interval: " << interval[config]
+		     << ", alternate halves: " << (alternateHalves[config] ? "yes" : "no")
+		     << ", half-life: " << halfLife << " frames. ";
+		runArchBenchmark(archDetector, vc, numFrames, reference, config == 0);
+		delete archDetector;
+	}
+}
+
+/*
+ * ArchDetector with the predicted roi for the blob detector (full frame every N frames),
+ * vs the whole frame. Throughput and mean error of the arch lines.
+ */
+void benchmarkPredictedRoi(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int numConfigs = 4;
+	int fullFrameInterval[numConfigs] = {0, 5, 10, 30};
+
+	ArchBenchmarkReference reference(numFrames);
+	for (int config = 0; config < numConfigs; config++) {
+		ArchDetector *archDetector = new ArchDetector();
+		archDetector->setPredictedRoi(fullFrameInterval[config], 20);
+
+		cout << "BENCHMARK. predicted roi, full frame interval: " << fullFrameInterval[config] << " (0 = disabled). ";
+		runArchBenchmark(archDetector, vc, numFrames, reference, config == 0);
+		delete archDetector;
+	}
+}
+
+
+/*
+ * Blob source of the arch detector: the blob detector (reference) vs the circle detector,
+ * with a wide and a narrow radius interval (times the arch width).
+ */
+void benchmarkCircleBlobs(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int numConfigs = 3;
+	int blobSource[numConfigs] = {BLOB_SOURCE_MORPH, BLOB_SOURCE_CIRCLES, BLOB_SOURCE_CIRCLES};
+	double radiusFactorMin[numConfigs] = {0, 0.02, 0.05};
+	double radiusFactorMax[numConfigs] = {0, 0.5, 0.25};
+
+	ArchBenchmarkReference reference(numFrames);
+	for (int config = 0; config < numConfigs; config++) {
+		ArchDetector *archDetector = new ArchDetector();
+		archDetector->setBlobSource(blobSource[config], radiusFactorMin[config], radiusFactorMax[config]);
+
+		if (blobSource[config] == BLOB_SOURCE_MORPH)
+			cout << "BENCHMARK. blob source, blob detector. ";
+		else
+			cout << "BENCHMARK. blob source, circles with radius " << radiusFactorMin[config] << ".." << radiusFactorMax[config] << " times the arch width. ";
+		runArchBenchmark(archDetector, vc, numFrames, reference, config == 0);
+		delete archDetector;
+	}
+}
+
+
+/*
+ * MorphBlobDetector, contours (cvFindContours) vs connected component labeling (BlobLabeler).
+ * Time of findBlobs (without drawing the blobs), number of blobs,
+ * and for the labeling, the mean distance from each blob to the nearest contour blob of the same frame.
+ */
+void benchmarkBlobEngine(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int maxBlobs = 1000;
+	int (*refCentroid)[2] = new int[numFrames * maxBlobs][2];
+	int *refNumBlobs = new int[numFrames];
+
+	int engines[2] = {BLOBS_CONTOURS, BLOBS_LABELING};
+	const char *engineNames[2] = {"contours", "labeling"};
+	for (int e = 0; e < 2; e++) {
+		MorphBlobDetector blobDetector;
+		blobDetector.setBlobEngine(engines[e]);
+		blobDetector.setDrawBlobs(false);
+
+		double secs = 0;
+		int totalBlobs = 0;
+		double distanceSum = 0;
+		int distanceCount = 0;
+		for (int frame = 0; frame < numFrames; frame++) {
+			IplImage *image = vc->cvQueryFrame(frame);
+			if (frame == 0)
+				blobDetector.init(image);
+
+			double timeStart = getTimeSecs();
+			blobDetector.findBlobs(image);
+			secs += getTimeSecs() - timeStart;
+			totalBlobs += blobDetector.numBlobs;
+
+			int (*ref)[2] = refCentroid + frame * maxBlobs;
+			if (e == 0) {
+				refNumBlobs[frame] = Min(blobDetector.numBlobs, maxBlobs);
+				for (int i = 0; i < refNumBlobs[frame]; i++) {
+					ref[i][0] = blobDetector.blobCentroid[i][0];
+					ref[i][1] = blobDetector.blobCentroid[i][1];
+				}
+			} else if (refNumBlobs[frame] > 0) {
+				for (int i = 0; i < blobDetector.numBlobs; i++) {
+					double minDistance2 = -1;
+					for (int j = 0; j < refNumBlobs[frame]; j++) {
+						double dx = blobDetector.blobCentroid[i][0] - ref[j][0];
+						double dy = blobDetector.blobCentroid[i][1] - ref[j][1];
+						if (minDistance2 < 0 || dx*dx + dy*dy < minDistance2)
+							minDistance2 = dx*dx + dy*dy;
+					}
+					distanceSum += sqrt(minDistance2);
+					distanceCount++;
+				}
+			}
+		}
+
+		cout << "BENCHMARK. blob engine " << engineNames[e] << ". "
+		     << "findBlobs: " << secs * 1000 / numFrames << " ms, "
+		     << "blobs per frame: " << (double)totalBlobs / numFrames;
+		if (e > 0)
+			cout << ", mean distance to the nearest contours blob: " << (distanceCount ? distanceSum / distanceCount : 0) << " pixels";
+		cout << endl;
+	}
+	delete[] refCentroid;
+	delete[] refNumBlobs;
+}
+
+
+
+//my_erode of MorphBlobDetector_alternative.m: rescans the image until nothing changes. returns the number of scans
+static int erodeByRescanning(IplImage *image, int minNeighbours) {
+	int width = image->width, height = image->height, step = image->widthStep;
+	uchar *data = (uchar*) image->imageData;
+	int scans = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		scans++;
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				if (!data[y*step + x])
+					continue;
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+						if ((dx || dy) && y + dy >= 0 && y + dy < height && x + dx >= 0 && x + dx < width && data[(y+dy)*step + x + dx])
+							count++;
+				if (count < minNeighbours) {
+					data[y*step + x] = 0;
+					changed = true;
+				}
+			}
+		}
+	}
+	return scans;
+}
+
+/*
+ * Blob detector (contours) with 1, 2, 4... threads (tiles), up to the number of cores.
+ * Time of findBlobs, the frames with the same blobs (and order) as one thread,
+ * and the mean distance of the blobs to the nearest blob of one thread.
+ */
+void benchmarkBlobThreads(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int maxBlobs = 1000;
+	int (*refCentroid)[2] = new int[numFrames * maxBlobs][2];
+	int *refNumBlobs = new int[numFrames];
+
+	int maxThreads = Max(getNumCores(), 2);
+	double serialSecs = 0;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+		MorphBlobDetector blobDetector;
+		blobDetector.setNumThreads(numThreads);
+		blobDetector.setDrawBlobs(false);
+
+		double secs = 0;
+		int sameFrames = 0;
+		double distanceSum = 0;
+		int distanceCount = 0;
+		for (int frame = 0; frame < numFrames; frame++) {
+			IplImage *image = vc->cvQueryFrame(frame);
+			if (frame == 0)
+				blobDetector.init(image);
+
+			double timeStart = getTimeSecs();
+			blobDetector.findBlobs(image);
+			secs += getTimeSecs() - timeStart;
+
+			int (*ref)[2] = refCentroid + frame * maxBlobs;
+			if (numThreads == 1) {
+				refNumBlobs[frame] = Min(blobDetector.numBlobs, maxBlobs);
+				memcpy(ref, blobDetector.blobCentroid, refNumBlobs[frame] * sizeof(ref[0]));
+				continue;
+			}
+			if (blobDetector.numBlobs == refNumBlobs[frame] && memcmp(ref, blobDetector.blobCentroid, refNumBlobs[frame] * sizeof(ref[0])) == 0)
+				sameFrames++;
+			for (int i = 0; i < blobDetector.numBlobs && refNumBlobs[frame] > 0; i++) {
+				double minDistance2 = -1;
+				for (int j = 0; j < refNumBlobs[frame]; j++) {
+					double dx = blobDetector.blobCentroid[i][0] - ref[j][0];
+					double dy = blobDetector.blobCentroid[i][1] - ref[j][1];
+					if (minDistance2 < 0 || dx*dx + dy*dy < minDistance2)
+						minDistance2 = dx*dx + dy*dy;
+				}
+				distanceSum += sqrt(minDistance2);
+				distanceCount++;
+			}
+		}
+		if (numThreads == 1)
+			serialSecs = secs;
+
+		cout << "BENCHMARK. blob detector " << numThreads << " threads. "
+		     << "findBlobs: " << secs * 1000 / numFrames << " ms, "
+		     << "speedup: " << serialSecs / secs;
+		if (numThreads > 1)
+			cout << ", frames with the same blobs as 1 thread: " << 100. * sameFrames / numFrames << "%"
+			     << ", mean distance to the nearest 1 thread blob: " << (distanceCount ? distanceSum / distanceCount : 0) << " pixels";
+		cout << endl;
+	}
+	delete[] refCentroid;
+	delete[] refNumBlobs;
+}
+
+
+
+/*
+ * BlobTracker on a synthetic sequence of 640x480: numBlobs blobs moving with constant velocity
+ * (up to 3 pixels per frame) and 1 pixel of noise, 10% of the detections dropped, and 5% of false blobs.
+ * Time of update, id switches (a true blob changing its id between frames where it was detected),
+ * and the dropped detections covered by a predicted track within 3 pixels.
+ */
+void benchmarkBlobTracker(int numBlobs) {
+	const int width = 640, height = 480, numFrames = 100;
+	double (*truth)[4] = new double[numBlobs][4];   //x, y, vx, vy
+	int *lastId = new int[numBlobs];
+	int (*centroid)[2] = new int[2 * numBlobs][2];
+	int *truthOfBlob = new int[2 * numBlobs];
+	srand(1);
+	for (int b = 0; b < numBlobs; b++) {
+		truth[b][0] = rand() % width;
+		truth[b][1] = rand() % height;
+		truth[b][2] = (rand() % 61 - 30) / 10.;
+		truth[b][3] = (rand() % 61 - 30) / 10.;
+		lastId[b] = -1;
+	}
+
+	BlobTracker tracker(width, height, 8, 2);
+	double secs = 0;
+	int idSwitches = 0, dropped = 0, droppedCovered = 0, detections = 0;
+	for (int frame = 0; frame < numFrames; frame++) {
+		int n = 0;
+		for (int b = 0; b < numBlobs; b++) {
+			//bounce on the borders
+			for (int k = 0; k < 2; k++) {
+				double size = (k == 0) ? width : height;
+				truth[b][k] += truth[b][k + 2];
+				if (truth[b][k] < 0 || truth[b][k] >= size) {
+					truth[b][k + 2] = -truth[b][k + 2];
+					truth[b][k] += 2 * truth[b][k + 2];
+				}
+			}
+			if (frame > 0 && rand() % 10 == 0) {
+				dropped++;
+				continue;
+			}
+			centroid[n][0] = (int)truth[b][0] + rand() % 3 - 1;
+			centroid[n][1] = (int)truth[b][1] + rand() % 3 - 1;
+			truthOfBlob[n] = b;
+			n++;
+		}
+		for (int f = 0; f < numBlobs / 20; f++) {
+			centroid[n][0] = rand() % width;
+			centroid[n][1] = rand() % height;
+			truthOfBlob[n] = -1;
+			n++;
+		}
+
+		double timeStart = getTimeSecs();
+		tracker.update(centroid, n);
+		secs += getTimeSecs() - timeStart;
+
+		bool *detected = new bool[numBlobs];
+		memset(detected, 0, numBlobs * sizeof(bool));
+		for (int i = 0; i < n; i++) {
+			int b = truthOfBlob[i];
+			if (b < 0)
+				continue;
+			detected[b] = true;
+			if (frame > 10) {
+				detections++;
+				if (lastId[b] != -1 && lastId[b] != tracker.idOfBlob[i])
+					idSwitches++;
+			}
+			lastId[b] = tracker.idOfBlob[i];
+		}
+		for (int b = 0; b < numBlobs; b++) {
+			if (detected[b] || frame <= 10)
+				continue;
+			for (int t = 0; t < tracker.numTracks; t++) {
+				double dx = tracker.tracks[t].x - truth[b][0];
+				double dy = tracker.tracks[t].y - truth[b][1];
+				if (tracker.tracks[t].missedFrames > 0 && dx*dx + dy*dy < 9) {
+					droppedCovered++;
+					break;
+				}
+			}
+		}
+		delete[] detected;
+	}
+
+	cout << "BENCHMARK. blob tracker, " << numBlobs << " blobs. "
+	     << "update: " << secs * 1000000 / numFrames << " us, "
+	     << "id switches: " << 100. * idSwitches / max(detections, 1) << "% of the detections, "
+	     << "dropped detections predicted: " << 100. * droppedCovered / max(dropped, 1) << "%" << endl;
+
+	delete[] truth;
+	delete[] lastId;
+	delete[] centroid;
+	delete[] truthOfBlob;
+}
+
+
+
+/*
+ * SobelEdgeDetector on a synthetic gray image (rings over noise), with and without thinning.
+ * SSE2 vs the scalar code (they must give the same edges).
+ */
+void benchmarkSobelEdges(int width, int height) {
+	IplImage *gray = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *edgesSimd = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *edgesScalar = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	srand(1);
+	int radius = height / 16;
+	for (int y = 0; y < height; y++) {
+		uchar *p = (uchar*) gray->imageData + y * gray->widthStep;
+		for (int x = 0; x < width; x++) {
+			int dx = (x % (4*radius)) - 2*radius;
+			int dy = (y % (4*radius)) - 2*radius;
+			p[x] = (uchar)((dx*dx + dy*dy < radius*radius) ? 180 + rand() % 20 : 60 + rand() % 40);
+		}
+	}
+
+	const int iterations = 50;
+	CvRect roi = cvRect(0, 0, width, height);
+	for (int thin = 0; thin <= 1; thin++) {
+		SobelEdgeDetector detector;
+		detector.setThin(thin != 0);
+		double secs[2];
+		for (int simd = 1; simd >= 0; simd--) {
+			detector.useSimd = (simd != 0);
+			IplImage *edges = simd ? edgesSimd : edgesScalar;
+			double timeStart = getTimeSecs();
+			for (int it = 0; it < iterations; it++)
+				detector.detect(gray, edges, roi, 200);
+			secs[simd] = (getTimeSecs() - timeStart) / iterations;
+		}
+
+		int differentPixels = 0, edgePixels = 0;
+		for (int y = 0; y < height; y++) {
+			uchar *a = (uchar*) edgesSimd->imageData + y * edgesSimd->widthStep;
+			uchar *b = (uchar*) edgesScalar->imageData + y * edgesScalar->widthStep;
+			for (int x = 0; x < width; x++) {
+				if (a[x] != b[x])
+					differentPixels++;
+				if (a[x])
+					edgePixels++;
+			}
+		}
+		cout << "BENCHMARK. sobel edges " << width << "x" << height << (thin ? " thin" : "") << ". "
+#ifdef HAVE_SSE2
+		     << "sse2: " << secs[1] * 1000 << " ms, "
+#else
+		     << "(no sse2) "
+#endif
+		     << "scalar: " << secs[0] * 1000 << " ms, "
+		     << "edge pixels: " << 100. * edgePixels / (width*height) << "%, "
+		     << "different pixels: " << differentPixels << endl;
+	}
+
+	cvReleaseImage(&gray);
+	cvReleaseImage(&edgesSimd);
+	cvReleaseImage(&edgesScalar);
+}
+
+/*
+ * Sobel edges vs cvCanny (100, 200) on the video frames.
+ * Time of the edge detector alone, and agreement of the edges (the edge pixels of one of them
+ * with an edge of the other one within 1 pixel). Then, the arch detector with each segmentation,
+ * compared with the canny one.
+ */
+void benchmarkSobelVsCanny(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	IplImage *image = vc->cvQueryFrame(0);
+	CvSize size = cvGetSize(image);
+	IplImage *gray = cvCreateImage(size, IPL_DEPTH_8U, 1);
+	IplImage *canny = cvCreateImage(size, IPL_DEPTH_8U, 1);
+	IplImage *sobel = cvCreateImage(size, IPL_DEPTH_8U, 1);
+	IplImage *dilated = cvCreateImage(size, IPL_DEPTH_8U, 1);
+	IplImage *both = cvCreateImage(size, IPL_DEPTH_8U, 1);
+	CvRect roi = cvRect(0, 0, size.width, size.height);
+
+	for (int thin = 0; thin <= 1; thin++) {
+		SobelEdgeDetector detector;
+		detector.setThin(thin != 0);
+		double cannySecs = 0, sobelSecs = 0;
+		int64 cannyPixels = 0, sobelPixels = 0, cannyMatched = 0, sobelMatched = 0;
+		for (int frame = 0; frame < numFrames; frame++) {
+			image = vc->cvQueryFrame(frame);
+			cvCvtColor(image, gray, CV_BGR2GRAY);
+
+			double timeStart = getTimeSecs();
+			cvCanny(gray, canny, 100, 200);
+			cannySecs += getTimeSecs() - timeStart;
+			timeStart = getTimeSecs();
+			detector.detect(gray, sobel, roi, 200);
+			sobelSecs += getTimeSecs() - timeStart;
+
+			cannyPixels += cvCountNonZero(canny);
+			sobelPixels += cvCountNonZero(sobel);
+			cvDilate(sobel, dilated);
+			cvAnd(canny, dilated, both);
+			cannyMatched += cvCountNonZero(both);
+			cvDilate(canny, dilated);
+			cvAnd(sobel, dilated, both);
+			sobelMatched += cvCountNonZero(both);
+		}
+		cout << "BENCHMARK. sobel" << (thin ? " thin" : "") << " vs canny. "
+		     << "canny: " << cannySecs * 1000 / numFrames << " ms, "
+		     << "sobel: " << sobelSecs * 1000 / numFrames << " ms, "
+		     << "speedup: " << cannySecs / sobelSecs << ", "
+		     << "canny edges found by sobel: " << 100. * cannyMatched / max(cannyPixels, (int64)1) << "%, "
+		     << "sobel edges found by canny: " << 100. * sobelMatched / max(sobelPixels, (int64)1) << "%" << endl;
+	}
+
+	cvReleaseImage(&gray);
+	cvReleaseImage(&canny);
+	cvReleaseImage(&sobel);
+	cvReleaseImage(&dilated);
+	cvReleaseImage(&both);
+
+	ArchBenchmarkReference reference(numFrames);
+	int segmentations[3] = {SEGMENT_CANNY, SEGMENT_SOBEL, SEGMENT_SOBEL_THIN};
+	const char *segmentationNames[3] = {"canny", "sobel", "sobel thin"};
+	for (int s = 0; s < 3; s++) {
+		ArchDetector *archDetector = new ArchDetector();
+		archDetector->setSegmentation(segmentations[s], NULL);
+		cout << "BENCHMARK. arch detector, " << segmentationNames[s] << ". ";
+		runArchBenchmark(archDetector, vc, numFrames, reference, s == 0);
+		delete archDetector;
+	}
+}
+
+
+
+/*
+ * CameraUndistort methods for each predefined lense, on a synthetic checkerboard:
+ * cvUndistort2 every frame, cvRemap with the precomputed float maps (the reference),
+ * and the fixed point remap (scalar, sse2, and sse2 with 4 threads).
+ * Time per frame, and the pixels which differ from the float remap by more than 1 gray level.
+ * Then, the point undistortion (see ArchDetector::setPointUndistortion): time of 100 points
+ * (the blobs and the horizon of a frame), and the error of distortPoint(undistortPoint(p)) over the image
+ * (for the pixels which can be undistorted, see CameraUndistort::undistortPoint).
+ */
+void benchmarkUndistort(int width, int height) {
+	IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	IplImage *reference = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	srand(1);
+	for (int y = 0; y < height; y++) {
+		uchar *p = (uchar*) image->imageData + y * image->widthStep;
+		for (int x = 0; x < width * 3; x++)
+			p[x] = (uchar)(((x / 3 / 16 + y / 16) % 2) * 160 + 40 + rand() % 16);
+	}
+
+	float *keyValues[4] = {Lense0KeyValues, Lense1KeyValues, Lense2KeyValues, Lense3KeyValues};
+	const int numConfigs = 5;
+	int method[numConfigs] = {UNDISTORT_DIRECT, UNDISTORT_REMAP, UNDISTORT_FIXED_POINT, UNDISTORT_FIXED_POINT, UNDISTORT_FIXED_POINT};
+	bool simd[numConfigs] = {true, true, false, true, true};
+	int threads[numConfigs] = {1, 1, 1, 1, 4};
+	const char *configNames[numConfigs] = {"cvUndistort2", "remap", "fixed point scalar", "fixed point sse2", "fixed point sse2 4 threads"};
+	const int iterations = 50;
+	for (int lense = 0; lense < 4; lense++) {
+		for (int config = 0; config < numConfigs; config++) {
+			CameraUndistort undistort(keyValues[lense]);
+			undistort.setMethod(method[config]);
+			undistort.setNumThreads(threads[config]);
+			undistort.useSimd = simd[config];
+			undistort.init(image);
+
+			IplImage *out = NULL;
+			double timeStart = getTimeSecs();
+			for (int it = 0; it < iterations; it++)
+				out = undistort.processImage(image);
+			double secs = (getTimeSecs() - timeStart) / iterations;
+
+			if (method[config] == UNDISTORT_REMAP)
+				cvCopy(out, reference);
+			int differentPixels = 0, maxDifference = 0;
+			for (int y = 0; y < height; y++) {
+				uchar *a = (uchar*) out->imageData + y * out->widthStep;
+				uchar *b = (uchar*) reference->imageData + y * reference->widthStep;
+				for (int x = 0; x < width * 3; x++) {
+					int difference = abs(a[x] - b[x]);
+					maxDifference = Max(maxDifference, difference);
+					if (difference > 1)
+						differentPixels++;
+				}
+			}
+
+			cout << "BENCHMARK. undistort Lense" << lense << " " << width << "x" << height << ", " << configNames[config] << ". "
+			     << "time: " << secs * 1000 << " ms";
+			if (method[config] == UNDISTORT_FIXED_POINT)
+				cout << ", differing by more than 1 gray level from remap: " << 100. * differentPixels / (width * height * 3) << "% (max " << maxDifference << ")";
+			cout << endl;
+		}
+
+		CameraUndistort undistort(keyValues[lense]);
+		const int numPoints = 100, pointIterations = 1000;
+		double timeStart = getTimeSecs();
+		for (int it = 0; it < pointIterations; it++) {
+			for (int i = 0; i < numPoints; i++) {
+				double x, y;
+				undistort.undistortPoint((i * 37) % width, (i * 23) % height, x, y);
+			}
+		}
+		double pointSecs = (getTimeSecs() - timeStart) / pointIterations;
+		double maxError = 0;
+		int gridPoints = 0, undistortedPoints = 0;
+		for (int y = 0; y < height; y += 8) {
+			for (int x = 0; x < width; x += 8) {
+				double ux, uy, dx, dy;
+				gridPoints++;
+				if (!undistort.undistortPoint(x, y, ux, uy))
+					continue;
+				undistortedPoints++;
+				undistort.distortPoint(ux, uy, dx, dy);
+				maxError = max(maxError, max(fabs(dx - x), fabs(dy - y)));
+			}
+		}
+		cout << "BENCHMARK. undistort Lense" << lense << " " << width << "x" << height << ", " << numPoints << " points. "
+		     << "time: " << pointSecs * 1000 << " ms, "
+		     << "pixels which can be undistorted: " << 100. * undistortedPoints / gridPoints << "%, "
+		     << "max error: " << maxError << " pixels" << endl;
+	}
+	cvReleaseImage(&image);
+	cvReleaseImage(&reference);
+}
+
+
+
+/*
+ * Fused undistortion front end (see CameraUndistort::setFusedOutput), on the synthetic checkerboard.
+ * Separate passes, as without it: fixed point remap, cvCvtColor to gray (blob detector)
+ * and computeSkyChannel (horizon detector), each one over the whole frame.
+ * Fused: the same in one pass, cropped to the valid region, and also downscaled by 2.
+ * Time per frame, and the checks of the fused output: black (invalid) pixels left by the crop,
+ * pixels differing by more than 1 gray level from the full remap at the same position (not downscaled),
+ * and pixels of the gray and sky planes differing from cvCvtColor and computeSkyChannel of the output.
+ */
+void benchmarkFusedUndistort(int width, int height) {
+	IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	IplImage *gray = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *sky = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *reference = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	srand(1);
+	for (int y = 0; y < height; y++) {
+		uchar *p = (uchar*) image->imageData + y * image->widthStep;
+		for (int x = 0; x < width * 3; x++)
+			p[x] = (uchar)(((x / 3 / 16 + y / 16) % 2) * 160 + 40 + rand() % 16);
+	}
+
+	float *keyValues[4] = {Lense0KeyValues, Lense1KeyValues, Lense2KeyValues, Lense3KeyValues};
+	const int iterations = 50;
+	for (int lense = 0; lense < 4; lense++) {
+		//separate passes
+		CameraUndistort separate(keyValues[lense]);
+		separate.setMethod(UNDISTORT_FIXED_POINT);
+		separate.init(image);
+		IplImage *out = NULL;
+		double timeStart = getTimeSecs();
+		for (int it = 0; it < iterations; it++) {
+			out = separate.processImage(image);
+			cvCvtColor(out, gray, CV_BGR2GRAY);
+			computeSkyChannel((uchar*) out->imageData, (uchar*) sky->imageData, width * height);
+		}
+		double separateSecs = (getTimeSecs() - timeStart) / iterations;
+		cvCopy(out, reference);
+		cout << "BENCHMARK. fused undistort Lense" << lense << " " << width << "x" << height << ", separate passes. "
+		     << "time: " << separateSecs * 1000 << " ms" << endl;
+
+		for (int downscale = 1; downscale <= 2; downscale++) {
+			CameraUndistort fused(keyValues[lense]);
+			fused.setMethod(UNDISTORT_FIXED_POINT);
+			fused.setFusedOutput(true, downscale, true);
+			fused.init(image);
+			timeStart = getTimeSecs();
+			for (int it = 0; it < iterations; it++)
+				out = fused.processImage(image);
+			double fusedSecs = (getTimeSecs() - timeStart) / iterations;
+
+			int outWidth = out->width, outHeight = out->height;
+			IplImage *outGray = cvCreateImage(cvSize(outWidth, outHeight), IPL_DEPTH_8U, 1);
+			IplImage *outSky = cvCreateImage(cvSize(outWidth, outHeight), IPL_DEPTH_8U, 1);
+			cvCvtColor(out, outGray, CV_BGR2GRAY);
+			computeSkyChannel((uchar*) out->imageData, (uchar*) outSky->imageData, outWidth * outHeight);
+			int blackPixels = 0, differentPixels = 0, differentPlanes = 0;
+			CvRect crop = fused.cropRect;
+			for (int y = 0; y < outHeight; y++) {
+				uchar *a = (uchar*) out->imageData + y * out->widthStep;
+				uchar *b = (uchar*) reference->imageData + (crop.y + y) * reference->widthStep + crop.x * 3;
+				for (int x = 0; x < outWidth; x++) {
+					if (a[3*x] == 0 && a[3*x + 1] == 0 && a[3*x + 2] == 0)
+						blackPixels++;
+					for (int c = 0; c < 3 && downscale == 1; c++)
+						if (abs(a[3*x + c] - b[3*x + c]) > 1)
+							differentPixels++;
+					int i = y * outWidth + x;
+					if (fused.grayImage->imageData[i] != outGray->imageData[i] || fused.skyImage->imageData[i] != outSky->imageData[i])
+						differentPlanes++;
+				}
+			}
+			cvReleaseImage(&outGray);
+			cvReleaseImage(&outSky);
+
+			cout << "BENCHMARK. fused undistort Lense" << lense << " " << width << "x" << height << ", fused downscale " << downscale << ". "
+			     << "time: " << fusedSecs * 1000 << " ms (" << separateSecs / fusedSecs << "x), "
+			     << "output " << outWidth << "x" << outHeight << " (crop " << crop.width << "x" << crop.height << "), "
+			     << "black pixels: " << blackPixels << ", ";
+			if (downscale == 1)
+				cout << "differing by more than 1 gray level from remap: " << 100. * differentPixels / (outWidth * outHeight * 3) << "%, ";
+			cout << "planes differing: " << differentPlanes << endl;
+		}
+	}
+	cvReleaseImage(&image);
+	cvReleaseImage(&gray);
+	cvReleaseImage(&sky);
+	cvReleaseImage(&reference);
+}
+
+
+
+/*
+ * Change detection.
+ * 1. TileChangeDetector alone, on a synthetic sequence: a static textured background
+ *    with a small moving square and some noise. Cost of update, and fraction of dirty tiles.
+ * 2. With a video (-if): the blob detector with and without change detection.
+ *    Time of findBlobs, mean fraction of dirty tiles, and the blobs per frame of both.
+ */
+void benchmarkTileChange(VideoCapture *vc) {
+	const int width = 640, height = 480, numFrames = 50;
+	IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	TileChangeDetector changeDetector(32, 4, 0);
+	changeDetector.init(width, height);
+	srand(1);
+	double secs = 0, dirtySum = 0;
+	for (int frame = 0; frame < numFrames; frame++) {
+		for (int y = 0; y < height; y++) {
+			uchar *p = (uchar*) image->imageData + y * image->widthStep;
+			for (int x = 0; x < width; x++, p += 3) {
+				bool square = x >= 100 + 4*frame && x < 160 + 4*frame && y >= 200 && y < 260;
+				int v = square ? 240 : ((x / 8 + y / 8) % 2) * 100 + 50 + rand() % 5;
+				p[0] = p[1] = p[2] = (uchar)v;
+			}
+		}
+		double timeStart = getTimeSecs();
+		changeDetector.update(image);
+		secs += getTimeSecs() - timeStart;
+		if (frame > 0)
+			dirtySum += changeDetector.dirtyFraction;
+	}
+	cout << "BENCHMARK. tile change " << width << "x" << height << " synthetic. "
+	     << "update: " << secs * 1000 / numFrames << " ms, "
+	     << "dirty tiles: " << 100. * dirtySum / (numFrames - 1) << "%" << endl;
+	cvReleaseImage(&image);
+
+	if (vc == NULL)
+		return;
+	int videoFrames = getBenchmarkNumFrames(vc);
+	for (int changeDetection = 0; changeDetection <= 1; changeDetection++) {
+		MorphBlobDetector blobDetector;
+		blobDetector.setDrawBlobs(false);
+		if (changeDetection)
+			blobDetector.setChangeDetection(32, 4, 30);
+		secs = 0;
+		dirtySum = 0;
+		int totalBlobs = 0;
+		for (int frame = 0; frame < videoFrames; frame++) {
+			IplImage *frameImage = vc->cvQueryFrame(frame);
+			if (frame == 0)
+				blobDetector.init(frameImage);
+			double timeStart = getTimeSecs();
+			blobDetector.findBlobs(frameImage);
+			secs += getTimeSecs() - timeStart;
+			dirtySum += blobDetector.dirtyTileFraction;
+			totalBlobs += blobDetector.numBlobs;
+		}
+		cout << "BENCHMARK. blob detector " << (changeDetection ? "with" : "without") << " change detection. "
+		     << "findBlobs: " << secs * 1000 / videoFrames << " ms, "
+		     << "dirty tiles: " << 100. * dirtySum / videoFrames << "%, "
+		     << "blobs per frame: " << (double)totalBlobs / videoFrames << endl;
+	}
+}
+
+
+
+/*
+ * Erosion of the FillErodeBlobDetector. Queue vs rescanning the image (as the matlab version).
+ * Synthetic edges: closed rings (balloons), open arcs and lines with spurs, and noise.
+ */
+void benchmarkFillErode(int width, int height) {
+	IplImage *edges = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *filledQueue = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	IplImage *filledRescan = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	cvZero(edges);
+	srand(1);
+	int step = edges->widthStep;
+	uchar *data = (uchar*) edges->imageData;
+	int radius = height / 20;
+	for (int i = 0; i < 12; i++) {
+		int xc = radius + 1 + rand() % (width - 2*radius - 2);
+		int yc = radius + 1 + rand() % (height - 2*radius - 2);
+		double arc = (i % 3 == 0) ? CV_PI : 2*CV_PI;   //some of them open
+		for (double a = 0; a < arc; a += 0.2 / radius)
+			data[(yc + (int)(radius * sin(a)))*step + xc + (int)(radius * cos(a))] = 255;
+	}
+	for (int i = 0; i < 8; i++) {
+		//a line with spurs, as the edges of the grass or the sky
+		int y = rand() % height;
+		for (int x = 0; x < width; x++) {
+			y = min(max(y + rand() % 3 - 1, 0), height - 1);
+			data[y*step + x] = 255;
+			if (rand() % 10 == 0 && y + 1 < height)
+				data[(y+1)*step + x] = 255;
+		}
+	}
+	for (int i = 0; i < width * height / 100; i++)
+		data[(rand() % height)*step + rand() % width] = 255;
+
+	FillErodeBlobDetector detector;
+	IplImage *frame = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	detector.init(frame);
+	const int iterations = 10;
+
+	double queueSecs = 0, rescanSecs = 0, fillSecs = 0;
+	int scans = 0;
+	for (int it = 0; it < iterations; it++) {
+		cvCopy(edges, filledQueue);
+		double timeStart = getTimeSecs();
+		detector.fillHoles(filledQueue);
+		fillSecs += getTimeSecs() - timeStart;
+		cvCopy(filledQueue, filledRescan);
+
+		timeStart = getTimeSecs();
+		detector.erode(filledQueue);
+		queueSecs += getTimeSecs() - timeStart;
+
+		timeStart = getTimeSecs();
+		scans = erodeByRescanning(filledRescan, 3);
+		rescanSecs += getTimeSecs() - timeStart;
+	}
+
+	int differentPixels = 0, remainingPixels = 0;
+	for (int y = 0; y < height; y++) {
+		uchar *q = (uchar*) filledQueue->imageData + y*filledQueue->widthStep;
+		uchar *r = (uchar*) filledRescan->imageData + y*filledRescan->widthStep;
+		for (int x = 0; x < width; x++) {
+			if ((q[x] != 0) != (r[x] != 0))
+				differentPixels++;
+			if (q[x])
+				remainingPixels++;
+		}
+	}
+
+	cout << "BENCHMARK. fill and erode " << width << "x" << height << ". "
+	     << "fillHoles: " << fillSecs * 1000 / iterations << " ms, "
+	     << "erode queue: " << queueSecs * 1000 / iterations << " ms, "
+	     << "erode rescanning: " << rescanSecs * 1000 / iterations << " ms (" << scans << " scans), "
+	     << "speedup: " << rescanSecs / queueSecs << ", "
+	     << "remaining pixels: " << remainingPixels << ", different pixels: " << differentPixels << endl;
+
+	cvReleaseImage(&edges);
+	cvReleaseImage(&filledQueue);
+	cvReleaseImage(&filledRescan);
+	cvReleaseImage(&frame);
+}
+
+
+
+/*
+ * Fixed vs adaptive canny thresholds of the blob detector.
+ * Prints the thresholds and contours of each frame, and the spread of the contours and of the time of findBlobs.
+ */
+void benchmarkAdaptiveCanny(VideoCapture *vc) {
+	int numFrames = getBenchmarkNumFrames(vc);
+	const int minContours = 20, maxContours = 60;
+
+	for (int adaptive = 0; adaptive <= 1; adaptive++) {
+		MorphBlobDetector blobDetector;
+		blobDetector.setDrawBlobs(false);
+		if (adaptive)
+			blobDetector.setAdaptiveCanny(minContours, maxContours);
+
+		double secsSum = 0, secsSum2 = 0, secsMax = 0;
+		double contoursSum = 0, contoursSum2 = 0;
+		int framesInRange = 0;
+		for (int frame = 0; frame < numFrames; frame++) {
+			IplImage *image = vc->cvQueryFrame(frame);
+			if (frame == 0)
+				blobDetector.init(image);
+
+			double low = blobDetector.cannyLowThreshold, high = blobDetector.cannyHighThreshold;
+			double timeStart = getTimeSecs();
+			blobDetector.findBlobs(image);
+			double secs = getTimeSecs() - timeStart;
+			int contours = blobDetector.numContours;
+
+			secsSum += secs;
+			secsSum2 += secs*secs;
+			secsMax = max(secsMax, secs);
+			contoursSum += contours;
+			contoursSum2 += (double)contours*contours;
+			if (contours >= minContours && contours <= maxContours)
+				framesInRange++;
+			if (adaptive)
+				cout << "frame " << frame << ": canny " << low << "/" << high << ", contours " << contours << ", blobs " << blobDetector.numBlobs << endl;
+		}
+
+		double secsMean = secsSum / numFrames;
+		double contoursMean = contoursSum / numFrames;
+		cout << "BENCHMARK. canny " << (adaptive ? "adaptive" : "fixed 100/200") << ". "
+		     << "findBlobs: " << secsMean * 1000 << " ms (std " << sqrt(max(secsSum2 / numFrames - secsMean*secsMean, 0.)) * 1000
+		     << ", max " << secsMax * 1000 << "), "
+		     << "contours: " << contoursMean << " (std " << sqrt(max(contoursSum2 / numFrames - contoursMean*contoursMean, 0.)) << "), "
+		     << "frames with " << minContours << ".." << maxContours << " contours: " << 100. * framesInRange / numFrames << "%" << endl;
+	}
+}
+
+
+
+/*
+ * Color segmentation of the blob detector. Lookup table vs the red rule evaluated per pixel.
+ * First, all the colors are checked (the table quantizes b,g,r to 5 bits),
+ * then a synthetic image with red balloons over a random background is timed.
+ */
+void benchmarkColorLut(int width, int height) {
+	const double maxHueDistanceD = 20, minSaturation = 0.4, minValue = 0.25;
+	ColorLut lut;
+	lut.buildRedRule(maxHueDistanceD, minSaturation, minValue);
+
+	int64 differentColors = 0, redColors = 0;
+	for (int b = 0; b < 256; b++)
+		for (int g = 0; g < 256; g++)
+			for (int r = 0; r < 256; r++) {
+				bool red = ColorLut::isRed(b, g, r, maxHueDistanceD, minSaturation, minValue);
+				if (red)
+					redColors++;
+				if (red != lut.classify(b, g, r))
+					differentColors++;
+			}
+
+	IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	IplImage *mask = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	srand(1);
+	for (int y = 0; y < height; y++) {
+		uchar *pixel = (uchar*) image->imageData + y * image->widthStep;
+		for (int x = 0; x < width; x++, pixel += 3) {
+			//a row of balloons of radius height/20, over noise
+			int dx = (x % (height/8)) - height/16;
+			int dy = y - height/2;
+			if (dx*dx + dy*dy < (height/20)*(height/20)) {
+				pixel[0] = 30 + rand() % 30;
+				pixel[1] = 20 + rand() % 30;
+				pixel[2] = 170 + rand() % 80;
+			} else {
+				pixel[0] = rand() % 256;
+				pixel[1] = rand() % 256;
+				pixel[2] = rand() % 256;
+			}
+		}
+	}
+
+	const int iterations = 50;
+	CvRect roi = cvRect(0, 0, width, height);
+	double timeStart = getTimeSecs();
+	for (int it = 0; it < iterations; it++)
+		lut.segment(image, mask, roi);
+	double lutSecs = getTimeSecs() - timeStart;
+
+	int differentPixels = 0;
+	timeStart = getTimeSecs();
+	for (int it = 0; it < iterations; it++) {
+		for (int y = 0; y < height; y++) {
+			uchar *pixel = (uchar*) image->imageData + y * image->widthStep;
+			uchar *maskPixel = (uchar*) mask->imageData + y * mask->widthStep;
+			for (int x = 0; x < width; x++, pixel += 3) {
+				bool red = ColorLut::isRed(pixel[0], pixel[1], pixel[2], maxHueDistanceD, minSaturation, minValue);
+				if (it == 0 && red != (maskPixel[x] != 0))
+					differentPixels++;
+			}
+		}
+	}
+	double ruleSecs = getTimeSecs() - timeStart;
+
+	cout << "BENCHMARK. color lut " << width << "x" << height << ". "
+	     << "table: " << lutSecs * 1000 / iterations << " ms, "
+	     << "rule per pixel: " << ruleSecs * 1000 / iterations << " ms, "
+	     << "speedup: " << ruleSecs / lutSecs << ", "
+	     << "different pixels: " << 100. * differentPixels / (width*height) << "%, "
+	     << "different colors: " << 100. * differentColors / (256*256*256) << "% "
+	     << "(red colors: " << 100. * redColors / (256*256*256) << "%)" << endl;
+
+	cvReleaseImage(&image);
+	cvReleaseImage(&mask);
+}
+
+
+
+/*
+ * Sky channel of the HorizonDetector. Reciprocal table (scalar) and computeSkyChannel (SSE2, if available)
+ * vs integer division.
+ * First, all the colors are checked with both kernels, then random images are timed.
+ */
+void benchmarkHorizon() {
+	//all the combinations: b = 0..255, r = 0..255, g = 0..255
+	uchar *bgrData = new uchar[256*256*3];
+	uchar *skyData = new uchar[256*256];
+	uchar *skyDataReference = new uchar[256*256];
+	uchar *skyDataScalar = new uchar[256*256];
+	int differentPixels = 0, differentPixelsScalar = 0;
+	for (int r = 0; r < 256; r++) {
+		for (int g = 0; g < 256; g++) {
+			for (int b = 0; b < 256; b++) {
+				bgrData[(g*256 + b)*3] = b;
+				bgrData[(g*256 + b)*3 + 1] = g;
+				bgrData[(g*256 + b)*3 + 2] = r;
+			}
+		}
+		computeSkyChannel(bgrData, skyData, 256*256);
+		computeSkyChannelScalar(bgrData, skyDataScalar, 256*256);
+		computeSkyChannelReference(bgrData, skyDataReference, 256*256);
+		for (int i = 0; i < 256*256; i++) {
+			differentPixels += (skyData[i] != skyDataReference[i]);
+			differentPixelsScalar += (skyDataScalar[i] != skyDataReference[i]);
+		}
+	}
+	cout << "BENCHMARK. sky channel, all the colors. different results: "
+#ifdef HAVE_SSE2
+	     << "sse2: " << differentPixels << ", "
+#else
+	     << "(no sse2) "
+#endif
+	     << "reciprocal table: " << differentPixelsScalar << endl;
+	delete[] bgrData;
+	delete[] skyData;
+	delete[] skyDataReference;
+	delete[] skyDataScalar;
+
+	const int iterations = 200;
+	int sizes[2][2] = {{320, 240}, {640, 480}};
+	srand(1);
+	for (int s = 0; s < 2; s++) {
+		int numPixels = sizes[s][0] * sizes[s][1];
+		bgrData = new uchar[numPixels*3];
+		skyData = new uchar[numPixels];
+		skyDataReference = new uchar[numPixels];
+		skyDataScalar = new uchar[numPixels];
+		for (int i = 0; i < numPixels*3; i++)
+			bgrData[i] = rand() & 255;
+
+		double timeStart = getTimeSecs();
+		for (int i = 0; i < iterations; i++)
+			computeSkyChannelReference(bgrData, skyDataReference, numPixels);
+		double referenceSecs = getTimeSecs() - timeStart;
+
+		timeStart = getTimeSecs();
+		for (int i = 0; i < iterations; i++)
+			computeSkyChannelScalar(bgrData, skyDataScalar, numPixels);
+		double scalarSecs = getTimeSecs() - timeStart;
+
+		timeStart = getTimeSecs();
+		for (int i = 0; i < iterations; i++)
+			computeSkyChannel(bgrData, skyData, numPixels);
+		double secs = getTimeSecs() - timeStart;
+
+		bool exact = (memcmp(skyData, skyDataReference, numPixels) == 0 && memcmp(skyDataScalar, skyDataReference, numPixels) == 0);
+		cout << "BENCHMARK. sky channel " << sizes[s][0] << "x" << sizes[s][1] << ". "
+		     << "division: " << referenceSecs * 1000 / iterations << " ms, "
+		     << "reciprocal table: " << scalarSecs * 1000 / iterations << " ms, "
+#ifdef HAVE_SSE2
+		     << "sse2: " << secs * 1000 / iterations << " ms, "
+#endif
+		     << "speedup: " << referenceSecs / secs << ", "
+		     << "bit exact: " << (exact ? "yes" : "NO") << endl;
+		delete[] bgrData;
+		delete[] skyData;
+		delete[] skyDataReference;
+		delete[] skyDataScalar;
+	}
+
+	benchmarkHorizonFusedPass(320, 240);
+	benchmarkHorizonFusedPass(640, 480);
+}
+
+
+//synthetic frame: blue sky over a brown ground, horizon through the center with the given angle, plus noise
+static void fillSyntheticHorizonImage(IplImage *image, double angleD) {
+	double a = tan(angleD * CV_PI / 180);
+	for (int y = 0; y < image->height; y++) {
+		uchar *row = (uchar *)(image->imageData + y * image->widthStep);
+		for (int x = 0; x < image->width; x++) {
+			bool sky = (y - image->height/2) < a * (x - image->width/2);
+			int noise = rand() % 40;
+			row[x*3]     = sky ? 180 + noise : 40 + noise;
+			row[x*3 + 1] = sky ? 120 + noise : 70 + noise;
+			row[x*3 + 2] = sky ? 90 + noise  : 100 + noise;
+		}
+	}
+}
+
+/*
+ * HorizonDetector, fused single pass vs the three passes (sky channel, otsu threshold, moments).
+ * Both must give the same horizon.
+ */
+void benchmarkHorizonFusedPass(int width, int height) {
+	const int numImages = 10;
+	const int iterations = 20;
+	IplImage *images[numImages];
+	srand(1);
+	for (int i = 0; i < numImages; i++) {
+		images[i] = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+		fillSyntheticHorizonImage(images[i], -40 + 8 * i);
+	}
+
+	HorizonDetector threePass, fused;
+	threePass.setFusedPass(false);
+	fused.setFusedPass(true);
+	threePass.init(images[0]);
+	fused.init(images[0]);
+
+	int differentResults = 0;
+	for (int i = 0; i < numImages; i++) {
+		Horizon h1 = *threePass.computeHorizon(images[i]);
+		Horizon h2 = *fused.computeHorizon(images[i]);
+		if (h1.skyX != h2.skyX || h1.skyY != h2.skyY || h1.groundX != h2.groundX || h1.groundY != h2.groundY
+			|| h1.angleR != h2.angleR || h1.x0 != h2.x0 || h1.y0 != h2.y0)
+			differentResults++;
+	}
+
+	double timeStart = getTimeSecs();
+	for (int it = 0; it < iterations; it++)
+		for (int i = 0; i < numImages; i++)
+			threePass.computeHorizon(images[i]);
+	double threePassSecs = getTimeSecs() - timeStart;
+
+	timeStart = getTimeSecs();
+	for (int it = 0; it < iterations; it++)
+		for (int i = 0; i < numImages; i++)
+			fused.computeHorizon(images[i]);
+	double fusedSecs = getTimeSecs() - timeStart;
+
+	cout << "BENCHMARK. horizon " << width << "x" << height << ". "
+	     << "three passes: " << threePassSecs * 1000 / (iterations*numImages) << " ms, "
+	     << "fused pass: " << fusedSecs * 1000 / (iterations*numImages) << " ms, "
+	     << "speedup: " << threePassSecs / fusedSecs << ", "
+	     << "different results: " << differentResults << endl;
+
+	for (int i = 0; i < numImages; i++)
+		cvReleaseImage(&images[i]);
+}
+
+
+
+/*
+ * HorizonDetector, tracking vs full passes,
+ * on a synthetic sequence with a slowly rolling horizon.
+ * Time of computeHorizon, and error of the horizon angle with respect to the full passes.
+ */
+void benchmarkHorizonTracking(int width, int height) {
+	const int numFrames = 60;
+	IplImage *images[numFrames];
+	srand(1);
+	for (int i = 0; i < numFrames; i++) {
+		images[i] = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+		fillSyntheticHorizonImage(images[i], 10 * sin(i * 0.1));
+	}
+
+	HorizonDetector full, tracking;
+	tracking.setTracking(height / 16, 30, 5);
+	full.init(images[0]);
+	tracking.init(images[0]);
+
+	double fullSecs = 0, trackingSecs = 0;
+	double errorSum = 0, errorMax = 0;
+	for (int i = 0; i < numFrames; i++) {
+		double timeStart = getTimeSecs();
+		double angleFull = full.computeHorizon(images[i])->angleD;
+		fullSecs += getTimeSecs() - timeStart;
+
+		timeStart = getTimeSecs();
+		double angleTracking = tracking.computeHorizon(images[i])->angleD;
+		trackingSecs += getTimeSecs() - timeStart;
+
+		double error = fmod(fabs(angleFull - angleTracking), 180);
+		error = min(error, 180 - error);
+		errorSum += error;
+		errorMax = max(errorMax, error);
+	}
+
+	cout << "BENCHMARK. horizon tracking " << width << "x" << height << ", band = " << height / 16 << " rows. "
+	     << "full: " << fullSecs * 1000 / numFrames << " ms, "
+	     << "tracking: " << trackingSecs * 1000 / numFrames << " ms, "
+	     << "speedup: " << fullSecs / trackingSecs << ", "
+	     << "angle error mean: " << errorSum / numFrames << " degrees, max: " << errorMax << " degrees" << endl;
+
+	for (int i = 0; i < numFrames; i++)
+		cvReleaseImage(&images[i]);
+}
+
+
+
+/*
+ * HorizonDetector, moments by row bands on 1, 2, 4... threads (up to the number of cores),
+ * fused pass and three passes.
+ * The results must be identical to one thread.
+ */
+void benchmarkHorizonThreads(int width, int height) {
+	const int numImages = 4;
+	const int iterations = 10;
+	IplImage *images[numImages];
+	srand(1);
+	for (int i = 0; i < numImages; i++) {
+		images[i] = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+		fillSyntheticHorizonImage(images[i], -30 + 20 * i);
+	}
+
+	int maxThreads = Max(getNumCores(), 2);
+	for (int fused = 1; fused >= 0; fused--) {
+		Horizon serialHorizon[numImages];
+		double serialSecs = 0;
+		for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+			HorizonDetector detector;
+			detector.setFusedPass(fused == 1);
+			detector.setNumThreads(numThreads);
+			detector.init(images[0]);
+
+			int differentResults = 0;
+			for (int i = 0; i < numImages; i++) {
+				Horizon h = *detector.computeHorizon(images[i]);
+				if (numThreads == 1)
+					serialHorizon[i] = h;
+				else if (h.skyX != serialHorizon[i].skyX || h.skyY != serialHorizon[i].skyY
+					|| h.groundX != serialHorizon[i].groundX || h.groundY != serialHorizon[i].groundY)
+					differentResults++;
+			}
+
+			double timeStart = getTimeSecs();
+			for (int it = 0; it < iterations; it++)
+				for (int i = 0; i < numImages; i++)
+					detector.computeHorizon(images[i]);
+			double secs = getTimeSecs() - timeStart;
+			if (numThreads == 1)
+				serialSecs = secs;
+
+			cout << "BENCHMARK. horizon " << (fused ? "fused pass" : "three passes") << " " << width << "x" << height << ", "
+			     << numThreads << " threads: " << secs * 1000 / (iterations*numImages) << " ms, "
+			     << "speedup: " << serialSecs / secs << ", "
+			     << "different results: " << differentResults << endl;
+		}
+	}
+
+	for (int i = 0; i < numImages; i++)
+		cvReleaseImage(&images[i]);
+}
+
+
+
+/*
+ * TelemetryHorizonSource vs HorizonDetector,
+ * on a synthetic sequence with a rolling horizon through the image center (pitch = 0),
+ * with the telemetry sampled at 4 times the frame rate.
+ * Time of getHorizon, and difference of the horizon angle.
+ */
+void benchmarkTelemetryHorizon(int width, int height) {
+	const int numFrames = 60;
+	const double framesPerSecond = 25;
+	TelemetryHorizonSource telemetry(300, framesPerSecond, 0);
+	for (int i = 0; i < numFrames * 4; i++) {
+		//the synthetic image has the horizon y = height/2 + tan(angle)*(x - width/2), so roll = -angle
+		double angleD = 10 * sin(i / 4. * 0.1);
+		telemetry.addSample(i / (4 * framesPerSecond), -angleD, 0);
+	}
+
+	IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	HorizonDetector detector;
+	detector.init(image);
+	telemetry.init(image);
+
+	srand(1);
+	double detectorSecs = 0, telemetrySecs = 0;
+	double errorSum = 0, errorMax = 0;
+	for (int i = 0; i < numFrames; i++) {
+		fillSyntheticHorizonImage(image, 10 * sin(i * 0.1));
+
+		double timeStart = getTimeSecs();
+		double angleImage = detector.getHorizon(image)->angleD;
+		detectorSecs += getTimeSecs() - timeStart;
+
+		timeStart = getTimeSecs();
+		double angleTelemetry = telemetry.getHorizon(image)->angleD;
+		telemetrySecs += getTimeSecs() - timeStart;
+
+		double error = fmod(fabs(angleImage - angleTelemetry), 180);
+		error = min(error, 180 - error);
+		errorSum += error;
+		errorMax = max(errorMax, error);
+	}
+
+	cout << "BENCHMARK. horizon " << width << "x" << height << ". "
+	     << "image: " << detectorSecs * 1000 / numFrames << " ms, "
+	     << "telemetry: " << telemetrySecs * 1000 / numFrames << " ms, "
+	     << "angle difference mean: " << errorSum / numFrames << " degrees, max: " << errorMax << " degrees" << endl;
+
+	cvReleaseImage(&image);
+}
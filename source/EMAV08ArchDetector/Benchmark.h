@@ -0,0 +1,67 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* See Benchmark.cpp for more info */
+
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include "util.h"
+#include "VideoCapture.h"
+
+void runBenchmark(const char *benchmarkId, VideoCapture *vc);
+
+void benchmarkHough();
+void benchmarkBlobInterval(VideoCapture *vc);
+void benchmarkBlobEngine(VideoCapture *vc);
+void benchmarkBlobThreads(VideoCapture *vc);
+void benchmarkTileChange(VideoCapture *vc);
+void benchmarkBlobTracker(int numBlobs);
+void benchmarkSobelEdges(int width, int height);
+void benchmarkSobelVsCanny(VideoCapture *vc);
+void benchmarkUndistort(int width, int height);
+void benchmarkFusedUndistort(int width, int height);
+void benchmarkColorLut(int width, int height);
+void benchmarkAdaptiveCanny(VideoCapture *vc);
+void benchmarkFillErode(int width, int height);
+void benchmarkPredictedRoi(VideoCapture *vc);
+void benchmarkCircleBlobs(VideoCapture *vc);
+void benchmarkHorizon();
+void benchmarkHorizonFusedPass(int width, int height);
+void benchmarkHorizonTracking(int width, int height);
+void benchmarkHorizonThreads(int width, int height);
+void benchmarkTelemetryHorizon(int width, int height);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * BLOB LABELER
+ * Connected component labeling, an alternative to cvFindContours + cvContourArea + cvArcLength.
+ * The input is a binary image (e.g. the canny edges, or a color mask), and the blobs are the regions
+ * enclosed by its connected components, as the external contours of cvFindContours:
+ *
+ * 1. the background (pixels == 0, 4-connected) is labeled,
+ *    and the background components not touching the border of roi are holes.
+ *    filled = foreground or hole.
+ * 2. the filled image (8-connected) is labeled, accumulating for each label in the same raster scan
+ *    the number of pixels, the boundary pixels, the sums of x and y and the bounding box.
+ *
+ * Step 1 can be disabled (setFillHoles), if the binary image has no holes to fill.
+ *
+ * Each scan uses union-find (the root is the smallest label), and at the end the statistics
+ * of each label are added to its root. The union-find buffers are allocated in the constructor,
+ * for the worst case (width*height/2 + 1 labels). The statistics of the labels and the components
+ * start small and grow geometrically when a frame needs more (counted in heapAllocations),
+ * as the worst case would be about 15 MB at 640x480. reserve preallocates them.
+ *
+ * The statistics are estimates of the contour measures:
+ *   cvContourArea  ~ pixels - boundaryPixels (the contour goes through the boundary pixels)
+ *   cvArcLength    ~ boundaryPixels
+ * (a thin edge line has area 0, as its contour)
+ */
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "util.h"
+#include "BlobLabeler.h"
+
+
+BlobLabeler::BlobLabeler(int width, int height) {
+	this->width = width;
+	this->height = height;
+	assert(width <= 65535 && height <= 65535);   //BlobLabelStats
+	maxLabels = width * height / 2 + 2;
+	labels = new int[width * height];
+	parent = new int[maxLabels];
+	touchesBorder = new bool[maxLabels];
+	componentOfLabel = new int[maxLabels];
+	labelStatsCapacity = Min(maxLabels, 1024);
+	labelStats = new BlobLabelStats[labelStatsCapacity];
+	componentsCapacity = Min(maxLabels, 256);
+	components = new BlobComponent[componentsCapacity];
+	numComponents = 0;
+	heapAllocations = 0;
+	maxLabelsUsed = 0;
+	maxComponentsUsed = 0;
+	fillHoles = true;
+	filledImage = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+}
+
+/*
+ * If fillHoles (default), the holes of the binary image are filled before labeling (step 1).
+ * Otherwise the binary image is labeled as it is.
+ */
+void BlobLabeler::setFillHoles(bool fillHoles) {
+	this->fillHoles = fillHoles;
+}
+
+/*
+ * Preallocates the statistics of numLabels labels (including the label 0) and numComponents components,
+ * e.g. the high-water marks of the first frames with some headroom.
+ */
+void BlobLabeler::reserve(int numLabels, int numComponents) {
+	numLabels = Min(numLabels, maxLabels);
+	if (numLabels > labelStatsCapacity) {
+		BlobLabelStats *newLabelStats = new BlobLabelStats[numLabels];
+		memcpy(newLabelStats, labelStats, labelStatsCapacity * sizeof(BlobLabelStats));
+		delete[] labelStats;
+		labelStats = newLabelStats;
+		labelStatsCapacity = numLabels;
+		heapAllocations++;
+	}
+	numComponents = Min(numComponents, maxLabels);
+	if (numComponents > componentsCapacity) {
+		BlobComponent *newComponents = new BlobComponent[numComponents];
+		memcpy(newComponents, components, componentsCapacity * sizeof(BlobComponent));
+		delete[] components;
+		components = newComponents;
+		componentsCapacity = numComponents;
+		heapAllocations++;
+	}
+}
+
+BlobLabeler::~BlobLabeler() {
+	delete[] labels;
+	delete[] parent;
+	delete[] touchesBorder;
+	delete[] componentOfLabel;
+	delete[] labelStats;
+	delete[] components;
+	cvReleaseImage(&filledImage);
+}
+
+
+inline int BlobLabeler::find(int label) {
+	while (parent[label] != label) {
+		parent[label] = parent[parent[label]];   //path halving
+		label = parent[label];
+	}
+	return label;
+}
+
+inline int BlobLabeler::unite(int label1, int label2) {
+	int root1 = find(label1);
+	int root2 = find(label2);
+	if (root1 < root2) {
+		parent[root2] = root1;
+		return root1;
+	}
+	parent[root1] = root2;
+	return root2;
+}
+
+
+/*
+ * Labels the blobs of binaryImage (pixels != 0) inside roi.
+ * Returns the number of blobs, in components[0..numComponents-1] (image coordinates).
+ */
+int BlobLabeler::label(IplImage *binaryImage, CvRect roi) {
+	assert(binaryImage->nChannels == 1);
+	assert(roi.x >= 0 && roi.y >= 0 && roi.x + roi.width <= width && roi.y + roi.height <= height);
+	this->roi = roi;
+	int rw = roi.width, rh = roi.height;
+	int srcStep = binaryImage->widthStep;
+	int filledStep = filledImage->widthStep;
+	uchar *srcData = (uchar*) binaryImage->imageData + roi.y*srcStep + roi.x;
+	uchar *filledData = (uchar*) filledImage->imageData + roi.y*filledStep + roi.x;
+
+	//1. BACKGROUND, 4-connected
+	if (fillHoles) {
+		fillImageHoles(srcData, srcStep, filledData, filledStep);
+	} else {
+		filledData = srcData;
+		filledStep = srcStep;
+	}
+
+	//2. FILLED, 8-connected, with the statistics
+	int numLabels = 1;   //label 0 = none
+	int *labelsY = labels;
+	uchar *filledY = filledData;
+	for (int y = 0; y < rh; y++, labelsY += rw, filledY += filledStep) {
+		for (int x = 0; x < rw; x++) {
+			if (!filledY[x]) {
+				labelsY[x] = 0;
+				continue;
+			}
+			int l = 0;
+			if (x > 0 && labelsY[x - 1])
+				l = labelsY[x - 1];
+			if (y > 0) {
+				int *labelsN = labelsY - rw;
+				for (int dx = -1; dx <= 1; dx++) {
+					if (x + dx < 0 || x + dx >= rw || !labelsN[x + dx])
+						continue;
+					int n = labelsN[x + dx];
+					l = (l == 0 || l == n) ? n : unite(l, n);
+				}
+			}
+			if (l == 0) {
+				l = numLabels++;
+				parent[l] = l;
+				if (l >= labelStatsCapacity)
+					reserve(2 * labelStatsCapacity, componentsCapacity);
+				BlobLabelStats &s = labelStats[l];
+				s.pixels = 0;
+				s.boundaryPixels = 0;
+				s.sumX = 0;
+				s.sumY = 0;
+				s.minX = s.maxX = x;
+				s.maxY = y;
+				s.startX = x;
+				s.startY = y;
+			}
+			labelsY[x] = l;
+
+			BlobLabelStats &s = labelStats[l];
+			s.pixels++;
+			s.sumX += x;
+			s.sumY += y;
+			if (x < s.minX) s.minX = x;
+			if (x > s.maxX) s.maxX = x;
+			if (y > s.maxY) s.maxY = y;
+			bool boundary = x == 0 || y == 0 || x == rw - 1 || y == rh - 1
+				|| !filledY[x - 1] || !filledY[x + 1] || !filledY[x - filledStep] || !filledY[x + filledStep];
+			if (boundary)
+				s.boundaryPixels++;
+		}
+	}
+
+	//add the statistics of each label to its root
+	//(the root is the first label of the component in raster order, so its start pixel is the first one)
+	numComponents = 0;
+	for (int l = 1; l < numLabels; l++) {
+		int root = find(l);
+		BlobLabelStats &s = labelStats[l];
+		if (root == l) {
+			if (numComponents == componentsCapacity)
+				reserve(labelStatsCapacity, 2 * componentsCapacity);
+			componentOfLabel[l] = numComponents;
+			BlobComponent &r = components[numComponents];
+			r.pixels = s.pixels;
+			r.boundaryPixels = s.boundaryPixels;
+			r.sumX = s.sumX;
+			r.sumY = s.sumY;
+			r.minX = s.minX;
+			r.maxX = s.maxX;
+			r.minY = s.startY;
+			r.maxY = s.maxY;
+			r.startX = s.startX;
+			r.startY = s.startY;
+			numComponents++;
+			continue;
+		}
+		BlobComponent &r = components[componentOfLabel[root]];
+		componentOfLabel[l] = componentOfLabel[root];
+		r.pixels += s.pixels;
+		r.boundaryPixels += s.boundaryPixels;
+		r.sumX += s.sumX;
+		r.sumY += s.sumY;
+		if (s.minX < r.minX) r.minX = s.minX;
+		if (s.maxX > r.maxX) r.maxX = s.maxX;
+		if (s.startY < r.minY) r.minY = s.startY;
+		if (s.maxY > r.maxY) r.maxY = s.maxY;
+	}
+	maxLabelsUsed = Max(maxLabelsUsed, numLabels);
+	maxComponentsUsed = Max(maxComponentsUsed, numComponents);
+
+	//image coordinates
+	for (int c = 0; c < numComponents; c++) {
+		BlobComponent &r = components[c];
+		r.sumX += (int64)roi.x * r.pixels;
+		r.sumY += (int64)roi.y * r.pixels;
+		r.minX += roi.x;
+		r.maxX += roi.x;
+		r.minY += roi.y;
+		r.maxY += roi.y;
+		r.startX += roi.x;
+		r.startY += roi.y;
+	}
+	return numComponents;
+}
+
+
+/*
+ * Step 1 of label: filled = foreground or hole, inside roi.
+ * The holes are the background components (4-connected) not touching the border of roi.
+ */
+void BlobLabeler::fillImageHoles(uchar *srcData, int srcStep, uchar *filledData, int filledStep) {
+	int rw = roi.width, rh = roi.height;
+	int numLabels = 1;   //label 0 = none
+	int *labelsY = labels;
+	uchar *srcY = srcData;
+	for (int y = 0; y < rh; y++, labelsY += rw, srcY += srcStep) {
+		for (int x = 0; x < rw; x++) {
+			if (srcY[x]) {
+				labelsY[x] = 0;
+				continue;
+			}
+			int w = (x > 0) ? labelsY[x - 1] : 0;
+			int n = (y > 0) ? labelsY[x - rw] : 0;
+			int l;
+			if (w && n) {
+				l = (w == n) ? w : unite(w, n);
+			} else if (w || n) {
+				l = w | n;
+			} else {
+				l = numLabels++;
+				parent[l] = l;
+				touchesBorder[l] = false;
+			}
+			labelsY[x] = l;
+			if (x == 0 || y == 0 || x == rw - 1 || y == rh - 1)
+				touchesBorder[l] = true;
+		}
+	}
+	for (int l = 1; l < numLabels; l++)
+		if (touchesBorder[l])
+			touchesBorder[find(l)] = true;
+	for (int l = 1; l < numLabels; l++)
+		touchesBorder[l] = touchesBorder[find(l)];
+
+	//filled = foreground or hole
+	labelsY = labels;
+	srcY = srcData;
+	uchar *filledY = filledData;
+	for (int y = 0; y < rh; y++, labelsY += rw, srcY += srcStep, filledY += filledStep)
+		for (int x = 0; x < rw; x++)
+			filledY[x] = (srcY[x] || !touchesBorder[labelsY[x]]) ? 255 : 0;
+}
+
+
+/*
+ * Draws (255) the filled pixels of the components with keep = true, inside roi of the last label call.
+ */
+void BlobLabeler::drawComponents(IplImage *image) {
+	assert(image->nChannels == 1);
+	int step = image->widthStep;
+	uchar *imageY = (uchar*) image->imageData + roi.y*step + roi.x;
+	int *labelsY = labels;
+	for (int y = 0; y < roi.height; y++, labelsY += roi.width, imageY += step)
+		for (int x = 0; x < roi.width; x++)
+			if (labelsY[x] && components[componentOfLabel[labelsY[x]]].keep)
+				imageY[x] = 255;
+}
@@ -0,0 +1,95 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* See BlobLabeler.cpp for more info */
+
+
+#ifndef __BLOB_LABELER_H
+#define __BLOB_LABELER_H
+
+#include "util.h"
+
+struct BlobComponent {
+	int pixels;            //filled area, in pixels
+	int boundaryPixels;    //pixels with a 4-neighbour outside the component
+	int64 sumX, sumY;      //image coordinates
+	int minX, minY, maxX, maxY;
+	int startX, startY;    //the first pixel in raster order (top row, leftmost), e.g. to trace its boundary
+	bool keep;             //set by the caller, for drawComponents
+};
+
+//the statistics of a label during the scan, roi coordinates (its first pixel is its top row, so minY = startY)
+struct BlobLabelStats {
+	int pixels;
+	int boundaryPixels;
+	int64 sumX, sumY;
+	unsigned short minX, maxX, maxY;
+	unsigned short startX, startY;
+};
+
+class BlobLabeler {
+public:
+	BlobLabeler(int width, int height);
+	void setFillHoles(bool fillHoles);
+	int label(IplImage *binaryImage, CvRect roi);
+	void reserve(int numLabels, int numComponents);
+	void drawComponents(IplImage *image);
+	~BlobLabeler();
+
+	int numComponents;
+	BlobComponent *components;
+
+	int heapAllocations;      //debug. buffers grown by label, so far
+	int maxLabelsUsed;        //high-water marks of label, so far
+	int maxComponentsUsed;
+
+private:
+	int find(int label);
+	int unite(int label1, int label2);
+	void fillImageHoles(uchar *srcData, int srcStep, uchar *filledData, int filledStep);
+
+	int width, height;
+	CvRect roi;
+	bool fillHoles;
+	int maxLabels;
+	int *labels;           //one for each pixel of roi
+	int *parent;           //union-find
+	bool *touchesBorder;   //background labels
+	int *componentOfLabel;
+	BlobLabelStats *labelStats;   //grown by label (see reserve)
+	int labelStatsCapacity;
+	int componentsCapacity;
+	IplImage *filledImage;
+};
+
+#endif
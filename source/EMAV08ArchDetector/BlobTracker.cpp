@@ -0,0 +1,217 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * BLOB TRACKER
+ * The blobs are detected again in every frame, without identity, and some of them flicker.
+ * The tracker associates the blobs of consecutive frames:
+ *
+ * 1. the blobs of the frame are hashed into a uniform grid of cells of maxDistance x maxDistance pixels.
+ * 2. each track (the oldest first) predicts its position (constant velocity), and takes
+ *    the nearest free blob within maxDistance. Only the 3x3 cells around the prediction are visited,
+ *    so the association is linear in the number of blobs (instead of tracks x blobs).
+ * 3. a matched track updates its velocity (exponential smoothing) and position.
+ *    A track without blob keeps its predicted position, for at most maxMissedFrames frames.
+ * 4. the free blobs start new tracks, with new ids.
+ *
+ * The tracked positions (trackedCentroid) can replace the blobCentroid of the blob detector.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "util.h"
+#include "BlobTracker.h"
+
+
+static const double velocitySmoothing = 0.5;   //weight of the last displacement
+
+
+BlobTracker::BlobTracker(int width, int height, double maxDistance, int maxMissedFrames) {
+	assert(maxDistance >= 1);
+	assert(maxMissedFrames >= 0);
+	this->width = width;
+	this->height = height;
+	this->maxDistance = maxDistance;
+	this->maxMissedFrames = maxMissedFrames;
+	gridWidth = (int)ceil(width / maxDistance);
+	gridHeight = (int)ceil(height / maxDistance);
+	cellHead = new int[gridWidth * gridHeight];
+	for (int c = 0; c < gridWidth * gridHeight; c++)
+		cellHead[c] = -1;
+	capacity = 0;
+	tracks = NULL;
+	trackedCentroid = NULL;
+	trackedPredicted = NULL;
+	idOfBlob = NULL;
+	nextInCell = NULL;
+	blobMatched = NULL;
+	reserve(256);
+	numTracks = 0;
+	numTrackedBlobs = 0;
+	nextId = 0;
+}
+
+BlobTracker::~BlobTracker() {
+	delete[] cellHead;
+	delete[] tracks;
+	delete[] trackedCentroid;
+	delete[] trackedPredicted;
+	delete[] idOfBlob;
+	delete[] nextInCell;
+	delete[] blobMatched;
+}
+
+//all the arrays have capacity elements (at least twice the previous capacity)
+void BlobTracker::reserve(int capacity) {
+	if (capacity <= this->capacity)
+		return;
+	capacity = Max(capacity, 2 * this->capacity);
+	TrackedBlob *newTracks = new TrackedBlob[capacity];
+	if (tracks != NULL)
+		memcpy(newTracks, tracks, numTracks * sizeof(TrackedBlob));
+	delete[] tracks;
+	tracks = newTracks;
+	delete[] trackedCentroid;
+	delete[] trackedPredicted;
+	delete[] idOfBlob;
+	delete[] nextInCell;
+	delete[] blobMatched;
+	trackedCentroid = new int[capacity][2];
+	trackedPredicted = new bool[capacity];
+	idOfBlob = new int[capacity];
+	nextInCell = new int[capacity];
+	blobMatched = new bool[capacity];
+	this->capacity = capacity;
+}
+
+//the cell of a position (the positions outside the image go to the border cells)
+inline int BlobTracker::cellOf(double x, double y) {
+	int cx = Min(Max((int)floor(x / maxDistance), 0), gridWidth - 1);
+	int cy = Min(Max((int)floor(y / maxDistance), 0), gridHeight - 1);
+	return cy * gridWidth + cx;
+}
+
+
+void BlobTracker::update(int (*blobCentroid)[2], int numBlobs) {
+	reserve(numTracks + numBlobs);
+
+	//1. hash the blobs
+	for (int i = 0; i < numBlobs; i++) {
+		int c = cellOf(blobCentroid[i][0], blobCentroid[i][1]);
+		nextInCell[i] = cellHead[c];
+		cellHead[c] = i;
+		blobMatched[i] = false;
+		idOfBlob[i] = -1;
+	}
+
+	//2, 3. match the tracks, the oldest first
+	double maxDistance2 = maxDistance * maxDistance;
+	int numKept = 0;
+	for (int t = 0; t < numTracks; t++) {
+		TrackedBlob track = tracks[t];
+		double px = track.x + track.vx;
+		double py = track.y + track.vy;
+		int cx = (int)floor(px / maxDistance);
+		int cy = (int)floor(py / maxDistance);
+
+		int best = -1;
+		double bestDistance2 = maxDistance2;
+		for (int y = Max(cy - 1, 0); y <= Min(cy + 1, gridHeight - 1); y++) {
+			for (int x = Max(cx - 1, 0); x <= Min(cx + 1, gridWidth - 1); x++) {
+				for (int i = cellHead[y * gridWidth + x]; i != -1; i = nextInCell[i]) {
+					if (blobMatched[i])
+						continue;
+					double dx = blobCentroid[i][0] - px;
+					double dy = blobCentroid[i][1] - py;
+					double distance2 = dx*dx + dy*dy;
+					if (distance2 < bestDistance2 || (distance2 == bestDistance2 && best != -1 && i < best)) {
+						bestDistance2 = distance2;
+						best = i;
+					}
+				}
+			}
+		}
+
+		if (best != -1) {
+			blobMatched[best] = true;
+			idOfBlob[best] = track.id;
+			double bx = blobCentroid[best][0];
+			double by = blobCentroid[best][1];
+			track.vx = velocitySmoothing * (bx - track.x) + (1 - velocitySmoothing) * track.vx;
+			track.vy = velocitySmoothing * (by - track.y) + (1 - velocitySmoothing) * track.vy;
+			track.x = bx;
+			track.y = by;
+			track.hits++;
+			track.missedFrames = 0;
+		} else {
+			track.x = px;
+			track.y = py;
+			track.missedFrames++;
+			bool inside = px >= 0 && px < width && py >= 0 && py < height;
+			if (track.missedFrames > maxMissedFrames || !inside)
+				continue;   //lost
+		}
+		tracks[numKept++] = track;
+	}
+	numTracks = numKept;
+
+	//4. new tracks for the free blobs
+	for (int i = 0; i < numBlobs; i++) {
+		if (!blobMatched[i]) {
+			TrackedBlob &track = tracks[numTracks++];
+			track.id = nextId++;
+			track.x = blobCentroid[i][0];
+			track.y = blobCentroid[i][1];
+			track.vx = 0;
+			track.vy = 0;
+			track.hits = 1;
+			track.missedFrames = 0;
+			idOfBlob[i] = track.id;
+		}
+		//clear the hash for the next frame
+		cellHead[cellOf(blobCentroid[i][0], blobCentroid[i][1])] = -1;
+	}
+
+	//the tracked positions
+	numTrackedBlobs = numTracks;
+	for (int t = 0; t < numTracks; t++) {
+		trackedCentroid[t][0] = Min(Max((int)floor(tracks[t].x + 0.5), 0), width - 1);
+		trackedCentroid[t][1] = Min(Max((int)floor(tracks[t].y + 0.5), 0), height - 1);
+		trackedPredicted[t] = tracks[t].missedFrames > 0;
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* See BlobTracker.cpp for more info */
+
+
+#ifndef __BLOB_TRACKER_H
+#define __BLOB_TRACKER_H
+
+#include "util.h"
+
+struct TrackedBlob {
+	int id;
+	double x, y;           //position (predicted, in the frames without a detection)
+	double vx, vy;         //velocity, pixels per frame
+	int hits;              //frames with a detection
+	int missedFrames;      //consecutive frames without a detection
+};
+
+class BlobTracker {
+public:
+	BlobTracker(int width, int height, double maxDistance, int maxMissedFrames);
+	void update(int (*blobCentroid)[2], int numBlobs);
+	~BlobTracker();
+
+	int numTracks;
+	TrackedBlob *tracks;          //the oldest first
+
+	//the positions of all the tracks (as blobCentroid, e.g. for LineHoughTransform::computeHough)
+	int numTrackedBlobs;
+	int (*trackedCentroid)[2];
+	bool *trackedPredicted;       //no detection in this frame
+
+	int *idOfBlob;                //the track id of each blob of the last update
+
+private:
+	void reserve(int capacity);
+	int cellOf(double x, double y);
+
+	int width, height;
+	double maxDistance;
+	int maxMissedFrames;
+	int nextId;
+
+	//uniform grid of cells of maxDistance x maxDistance, with a list of the blobs of each cell
+	int gridWidth, gridHeight;
+	int *cellHead;                //first blob of each cell, -1 = none
+	int *nextInCell;              //next blob of the same cell, -1 = none
+	bool *blobMatched;
+	int capacity;
+};
+
+#endif
@@ -37,9 +37,21 @@
  *
  * The camera needs to be calibrated before, using the CameraCalibrate software,
  * which takes several images of a predefined chessboard.
+ *
+ * The undistortion mapping depends only on the calibration and the image size,
+ * so init computes it once (cvInitUndistortMap), and processImage only remaps each frame
+ * (bilinear), instead of cvUndistort2 recomputing the mapping for every frame.
+ * The maps can also be converted to fixed point, for a faster remap (see UNDISTORT_FIXED_POINT),
+ * which can also crop, downscale and compute the gray and sky channel planes of the detectors
+ * in the same pass (see setFusedOutput).
+ * If only a few points are needed (e.g. the blob centroids), they can be undistorted
+ * one by one with the lense model instead (see undistortPoint), without warping the image.
  */
  
 
+#include <cassert>
+#include <climits>
+#include <cmath>
 #include <iostream>
 using namespace std;
 
@@ -48,6 +60,12 @@ using namespace std;
 //#include <OpenCV/cv.h>
 //#include <OpenCV/highgui.h>
 #include "CameraUndistort.h"
+#include "HorizonDetector.h"
+#include "Parallel.h"
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
 
 float Lense0KeyValues[8] = {684.6002f, 386.9515f, 698.2037f,  242.8590f, -0.2724f, 0.0201f,  0.0069f, -0.0089f};
 float Lense1KeyValues[8] = {820.3981f, 101.1703f, 855.8934f, 1845.4957f, -0.0072f, 0.0002f, -0.0047f,  0.0052f};
@@ -131,29 +149,395 @@ void createUndistortMatrix(float *_intr, float *_dist, CvMat **_intrinsics, CvMa
 
 CameraUndistort::CameraUndistort(const char *calibFilename) {
     readCameraCalibration(calibFilename, &intrinsics, &distortion_coeffs);
+	setDefaults();
 }
 
 CameraUndistort::CameraUndistort(float *_intr, float *_dist) {
 	createUndistortMatrix(_intr, _dist, &intrinsics, &distortion_coeffs);
+	setDefaults();
 }
 
 CameraUndistort::CameraUndistort(float *keyValues) {
 	createUndistortMatrix(keyValues, &intrinsics, &distortion_coeffs);
+	setDefaults();
+}
+
+void CameraUndistort::setDefaults() {
+	method = UNDISTORT_REMAP;
+	numThreads = 1;
+	useSimd = true;
+	out_image = mapx = mapy = NULL;
+	grayImage = skyImage = NULL;
+	fusedCrop = fusedPlanes = false;
+	downscale = 1;
+	fixedMap = NULL;
+	fixedWeights = NULL;
+
+	//the lense model, for undistortPoint
+	float *intr = (float*)intrinsics->data.ptr;
+	float *dist = (float*)distortion_coeffs->data.ptr;
+	focalX = intr[0]; centerX = intr[2];
+	focalY = intr[4]; centerY = intr[5];
+	k1 = dist[0]; k2 = dist[1]; p1 = dist[2]; p2 = dist[3];
+}
+
+/*
+ * UNDISTORT_DIRECT: cvUndistort2 every frame (recomputes the mapping).
+ * UNDISTORT_REMAP (default): cvRemap with the float maps computed by init.
+ * UNDISTORT_FIXED_POINT: bilinear remap with a fixed point map (see buildFixedPointMap),
+ *                        by bands of rows in numThreads threads. 3/4 of the map memory of UNDISTORT_REMAP.
+ * Call it before init.
+ */
+void CameraUndistort::setMethod(int method) {
+	assert(method == UNDISTORT_DIRECT || method == UNDISTORT_REMAP || method == UNDISTORT_FIXED_POINT);
+	this->method = method;
+}
+
+/*
+ * Number of threads for UNDISTORT_FIXED_POINT (call it before init).
+ * Default = 1, all in the calling thread.
+ */
+void CameraUndistort::setNumThreads(int numThreads) {
+	assert(numThreads >= 1);
+	this->numThreads = numThreads;
+}
+
+/*
+ * Fused output, for UNDISTORT_FIXED_POINT (call it before init).
+ * The undistorted image is usually followed by more passes over the whole frame:
+ * the gray image of the blob detector, the sky channel of the horizon detector, and maybe a downscale.
+ * Here they are all done in the remap pass, row by row, while the row is still in the cache:
+ * crop: processImage is only the valid region of the undistorted image (no black borders, see buildFusedMap).
+ * downscale: processImage is downscale times smaller (each pixel samples the center of its block, no averaging).
+ * planes: grayImage (as cvCvtColor CV_BGR2GRAY) and skyImage (see computeSkyChannel) of processImage.
+ * The map samples the lense model directly, so a downscaled output costs less than the full one.
+ * The width of processImage is rounded down to a multiple of 4 (rows without padding, as the detectors expect).
+ */
+void CameraUndistort::setFusedOutput(bool crop, int downscale, bool planes) {
+	assert(downscale >= 1);
+	fusedCrop = crop;
+	this->downscale = downscale;
+	fusedPlanes = planes;
+}
+
+/*
+ * The size of the source frames, and the downscale of processImage (see setFusedOutput). Call them after init.
+ * With the fused output, the pixel (X, Y) of processImage is the pixel
+ * (cropRect.x + (X + 0.5) * downscale - 0.5, cropRect.y + (Y + 0.5) * downscale - 0.5) of the undistorted frame.
+ */
+CvSize CameraUndistort::getSourceSize() {
+	return cvSize(srcWidth, srcHeight);
+}
+
+int CameraUndistort::getDownscale() {
+	return downscale;
 }
 
 void CameraUndistort::init(IplImage *current_frame) {
+	srcWidth = current_frame->width;
+	srcHeight = current_frame->height;
+	if (fusedCrop || downscale > 1 || fusedPlanes) {
+		assert(method == UNDISTORT_FIXED_POINT);
+		buildFusedMap();
+		return;
+	}
+
 	out_image    = cvCreateImage(cvSize (current_frame->width, current_frame->height), IPL_DEPTH_8U, 3);
 	assert (out_image);
+	if (method == UNDISTORT_DIRECT)
+		return;
+
+	//undistortion maps, once
+	mapx = cvCreateImage(cvSize(current_frame->width, current_frame->height), IPL_DEPTH_32F, 1);
+	mapy = cvCreateImage(cvSize(current_frame->width, current_frame->height), IPL_DEPTH_32F, 1);
+	cvInitUndistortMap(intrinsics, distortion_coeffs, mapx, mapy);
+
+	if (method == UNDISTORT_FIXED_POINT) {
+		buildFixedPointMap();
+		cvReleaseImage(&mapx);
+		cvReleaseImage(&mapy);
+	}
 }
 
 IplImage * CameraUndistort::processImage(IplImage *src_image)
 {
-	cvUndistort2(src_image, out_image, intrinsics, distortion_coeffs);
+	if (method == UNDISTORT_FIXED_POINT) {
+		assert(src_image->nChannels == 3 && src_image->width == srcWidth && src_image->height == srcHeight);
+		bandSrcImage = src_image;
+		parallelFor(numThreads, remapBand, this, numThreads);
+	} else if (method == UNDISTORT_REMAP) {
+		cvRemap(src_image, out_image, mapx, mapy, CV_INTER_LINEAR + CV_WARP_FILL_OUTLIERS, cvScalarAll(0));
+	} else {
+		cvUndistort2(src_image, out_image, intrinsics, distortion_coeffs);
+	}
 	return out_image;
 }
 
 CameraUndistort::~CameraUndistort() {
 	cvReleaseImage(&out_image);
+	cvReleaseImage(&mapx);
+	cvReleaseImage(&mapy);
+	cvReleaseImage(&grayImage);
+	cvReleaseImage(&skyImage);
+	delete[] fixedMap;
+	delete[] fixedWeights;
     cvReleaseMat(&intrinsics);
     cvReleaseMat(&distortion_coeffs);
 }
+
+
+/*
+ * POINT UNDISTORTION
+ * The undistorted image (processImage) at (x, y) takes the pixel of the source image at distortPoint(x, y)
+ * (the model of cvInitUndistortMap: radial k1 k2, tangential p1 p2).
+ * undistortPoint is the inverse: where a pixel (x, y) of the source image goes in the undistorted image.
+ * There is no closed form, so the normalized point is refined by fixed point iteration (as cvUndistortPoints),
+ * which converges quickly for these lenses (about 1e-3 pixels after 10 iterations, see benchmarkUndistort).
+ * With a strong barrel distortion, the model does not reach the corners of the source image
+ * (no undistorted pixel comes from them), and the iteration diverges:
+ * undistortPoint returns false if distortPoint of the result is not back within maxUndistortError pixels.
+ * The result may be outside the image (the undistorted image crops it).
+ */
+static const int undistortIterations = 10;
+static const double maxUndistortError = 0.1;
+
+void CameraUndistort::distortPoint(double x, double y, double &distortedX, double &distortedY)
+{
+	double nx = (x - centerX) / focalX, ny = (y - centerY) / focalY;
+	double r2 = nx*nx + ny*ny;
+	double radial = 1 + (k1 + k2*r2)*r2;
+	distortedX = focalX * (nx*radial + 2*p1*nx*ny + p2*(r2 + 2*nx*nx)) + centerX;
+	distortedY = focalY * (ny*radial + p1*(r2 + 2*ny*ny) + 2*p2*nx*ny) + centerY;
+}
+
+bool CameraUndistort::undistortPoint(double x, double y, double &undistortedX, double &undistortedY)
+{
+	double dx = (x - centerX) / focalX, dy = (y - centerY) / focalY;
+	double nx = dx, ny = dy;
+	for (int i = 0; i < undistortIterations; i++) {
+		double r2 = nx*nx + ny*ny;
+		double radial = 1 + (k1 + k2*r2)*r2;
+		double tangentialX = 2*p1*nx*ny + p2*(r2 + 2*nx*nx);
+		double tangentialY = p1*(r2 + 2*ny*ny) + 2*p2*nx*ny;
+		nx = (dx - tangentialX) / radial;
+		ny = (dy - tangentialY) / radial;
+	}
+	undistortedX = focalX * nx + centerX;
+	undistortedY = focalY * ny + centerY;
+
+	double distortedX, distortedY;
+	distortPoint(undistortedX, undistortedY, distortedX, distortedY);
+	return fabs(distortedX - x) <= maxUndistortError && fabs(distortedY - y) <= maxUndistortError;
+}
+
+
+/*
+ * FIXED POINT REMAP
+ * For each destination pixel, fixedMap has the top-left source pixel (int16 x, y),
+ * and fixedWeights the position inside it in 1/128 pixels (7 bits for x and for y):
+ * 6 bytes per pixel instead of the 8 of the float maps.
+ * The interpolation is exact in integers (weights sum 128*128), rounded at the end.
+ * With 7 bits, the 255*128 products still fit in 16 bits (SSE2), and the position error (1/256 pixel)
+ * keeps the result within 1 gray level of the float remap even on sharp edges
+ * (with 5 bits and 4 bytes per pixel, about 5% of the pixels of a checkerboard differ by 2-5 levels).
+ * The destination pixels whose 2x2 source neighbourhood is not inside the image are black (outlierMark).
+ */
+static const int fixedBits = 7;
+static const int fixedOne = 1 << fixedBits;
+static const short outlierMark = -1;
+
+void CameraUndistort::buildFixedPointMap()
+{
+	int width = out_image->width, height = out_image->height;
+	assert(width <= SHRT_MAX && height <= SHRT_MAX);
+	fixedMap = new short[width * height][2];
+	fixedWeights = new ushort[width * height];
+	for (int y = 0; y < height; y++) {
+		float *mx = (float*)(mapx->imageData + y * mapx->widthStep);
+		float *my = (float*)(mapy->imageData + y * mapy->widthStep);
+		for (int x = 0; x < width; x++)
+			setFixedMapEntry(y * width + x, mx[x], my[x]);
+	}
+}
+
+//the bilinear interpolation at (sx, sy) only reads inside the source image
+static inline bool insideSource(double sx, double sy, int srcWidth, int srcHeight) {
+	return sx >= 0 && sx < srcWidth - 1 && sy >= 0 && sy < srcHeight - 1;
+}
+
+//destination pixel i takes the source image at (sx, sy)
+void CameraUndistort::setFixedMapEntry(int i, double sx, double sy)
+{
+	//the maps can be far outside the image
+	if (!insideSource(sx, sy, srcWidth, srcHeight)) {
+		fixedMap[i][0] = fixedMap[i][1] = outlierMark;
+		fixedWeights[i] = 0;
+		return;
+	}
+	int fx = Min(cvRound(sx * fixedOne), (srcWidth - 1) * fixedOne - 1);
+	int fy = Min(cvRound(sy * fixedOne), (srcHeight - 1) * fixedOne - 1);
+	fixedMap[i][0] = (short)(fx >> fixedBits);
+	fixedMap[i][1] = (short)(fy >> fixedBits);
+	fixedWeights[i] = (ushort)((fx & (fixedOne - 1)) | ((fy & (fixedOne - 1)) << fixedBits));
+}
+
+
+/*
+ * FUSED OUTPUT (see setFusedOutput)
+ * The crop is the rectangle of the full resolution undistorted image without invalid pixels
+ * (the ones outside the source image, black in the plain remap).
+ * Starting from the whole image, the border row or column with most invalid pixels is removed, until none has any.
+ * The output pixel (X, Y) samples the undistorted image at the center of its downscale x downscale block,
+ * which is the source image at distortPoint of it (the same model as cvInitUndistortMap).
+ */
+static int countInvalid(const bool *valid, int width, int x, int y, int dx, int dy, int n) {
+	int count = 0;
+	for (int i = 0; i < n; i++, x += dx, y += dy)
+		if (!valid[y * width + x])
+			count++;
+	return count;
+}
+
+void CameraUndistort::buildFusedMap()
+{
+	assert(srcWidth <= SHRT_MAX && srcHeight <= SHRT_MAX);
+	cropRect = cvRect(0, 0, srcWidth, srcHeight);
+	if (fusedCrop) {
+		bool *valid = new bool[srcWidth * srcHeight];
+		for (int y = 0; y < srcHeight; y++) {
+			for (int x = 0; x < srcWidth; x++) {
+				double sx, sy;
+				distortPoint(x, y, sx, sy);
+				valid[y * srcWidth + x] = insideSource(sx, sy, srcWidth, srcHeight);
+			}
+		}
+		int x0 = 0, y0 = 0, x1 = srcWidth, y1 = srcHeight;
+		while (x0 < x1 && y0 < y1) {
+			int top    = countInvalid(valid, srcWidth, x0, y0, 1, 0, x1 - x0);
+			int bottom = countInvalid(valid, srcWidth, x0, y1 - 1, 1, 0, x1 - x0);
+			int left   = countInvalid(valid, srcWidth, x0, y0, 0, 1, y1 - y0);
+			int right  = countInvalid(valid, srcWidth, x1 - 1, y0, 0, 1, y1 - y0);
+			int worst = Max(Max(top, bottom), Max(left, right));
+			if (worst == 0)
+				break;
+			if (top == worst)         y0++;
+			else if (bottom == worst) y1--;
+			else if (left == worst)   x0++;
+			else                      x1--;
+		}
+		delete[] valid;
+		cropRect = cvRect(x0, y0, x1 - x0, y1 - y0);
+	}
+
+	int width = (cropRect.width / downscale) & ~3;
+	int height = cropRect.height / downscale;
+	assert(width > 0 && height > 0);
+	out_image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	assert(out_image && out_image->widthStep == width * 3);
+	cout << "CameraUndistort. fused output " << width << "x" << height << ", crop " << cropRect.width << "x" << cropRect.height
+	     << " at (" << cropRect.x << ", " << cropRect.y << "), downscale " << downscale << endl;
+
+	fixedMap = new short[width * height][2];
+	fixedWeights = new ushort[width * height];
+	for (int y = 0; y < height; y++) {
+		double v = cropRect.y + (y + 0.5) * downscale - 0.5;
+		for (int x = 0; x < width; x++) {
+			double u = cropRect.x + (x + 0.5) * downscale - 0.5;
+			double sx, sy;
+			distortPoint(u, v, sx, sy);
+			setFixedMapEntry(y * width + x, sx, sy);
+		}
+	}
+
+	if (fusedPlanes) {
+		grayImage = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+		skyImage = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+		assert(grayImage->widthStep == width && skyImage->widthStep == width);
+		computeSkyChannel(NULL, NULL, 0);   //initializes its table, before the threads
+	}
+}
+
+/*
+ * The planes of the output row y, just remapped.
+ * gray: the fixed point formula of cvCvtColor CV_BGR2GRAY (0.299 r + 0.587 g + 0.114 b, 14 bits), the same result.
+ */
+void CameraUndistort::computePlanesRow(int y)
+{
+	int width = out_image->width;
+	uchar *bgr = (uchar*) out_image->imageData + y * out_image->widthStep;
+	uchar *gray = (uchar*) grayImage->imageData + y * grayImage->widthStep;
+	for (int x = 0; x < width; x++, bgr += 3)
+		gray[x] = (uchar)((bgr[0] * 1868 + bgr[1] * 9617 + bgr[2] * 4899 + (1 << 13)) >> 14);
+	computeSkyChannel((uchar*) out_image->imageData + y * out_image->widthStep,
+	                  (uchar*) skyImage->imageData + y * skyImage->widthStep, width);
+}
+
+//the band bandIdx of the destination rows (see setNumThreads)
+void CameraUndistort::remapBand(void *cameraUndistort, int bandIdx) {
+	CameraUndistort *undistort = (CameraUndistort *)cameraUndistort;
+	int height = undistort->out_image->height;
+	int numBands = undistort->numThreads;
+	undistort->remapFixedPointRows(undistort->bandSrcImage, height * bandIdx / numBands, height * (bandIdx + 1) / numBands);
+}
+
+/*
+ * Destination rows [y0, y1).
+ * With SSE2, a pixel is interpolated in 16 bit integers: the 3 channels of both source pixels
+ * of a row are loaded at once (8 bytes), weighted horizontally, and then vertically with madd.
+ * The last source row uses the scalar code, so that the 8 bytes loads do not read after the image.
+ * With the planes (see setFusedOutput), they are computed after each row, still in the cache.
+ */
+void CameraUndistort::remapFixedPointRows(IplImage *srcImage, int y0, int y1)
+{
+	int width = out_image->width;
+	int srcStep = srcImage->widthStep;
+	const uchar *src = (const uchar*) srcImage->imageData;
+#ifdef HAVE_SSE2
+	const uchar *srcLastRow = src + (srcImage->height - 1) * srcStep;
+	bool simd = useSimd;
+	__m128i zero = _mm_setzero_si128();
+	__m128i round = _mm_set1_epi32(1 << (2*fixedBits - 1));
+#endif
+
+	for (int y = y0; y < y1; y++) {
+		uchar *dst = (uchar*) out_image->imageData + y * out_image->widthStep;
+		short (*m)[2] = fixedMap + y * width;
+		ushort *w = fixedWeights + y * width;
+		for (int x = 0; x < width; x++, dst += 3) {
+			if (m[x][0] == outlierMark) {
+				dst[0] = dst[1] = dst[2] = 0;
+				continue;
+			}
+			int fx = w[x] & (fixedOne - 1), fy = w[x] >> fixedBits;
+			const uchar *p = src + m[x][1] * srcStep + m[x][0] * 3;
+#ifdef HAVE_SSE2
+			if (simd && p + srcStep < srcLastRow) {
+				//a0 a1 a2 b0 b1 b2 (top row), c0 c1 c2 d0 d1 d2 (bottom row)
+				__m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+				__m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + srcStep)), zero);
+				__m128i wx = _mm_set_epi16(0, 0, fx, fx, fx, fixedOne - fx, fixedOne - fx, fixedOne - fx);
+				top = _mm_mullo_epi16(top, wx);
+				bottom = _mm_mullo_epi16(bottom, wx);
+				top = _mm_add_epi16(top, _mm_srli_si128(top, 6));         //a*(128-fx) + b*fx <= 32640
+				bottom = _mm_add_epi16(bottom, _mm_srli_si128(bottom, 6));
+				__m128i wy = _mm_set_epi16(fy, fixedOne - fy, fy, fixedOne - fy, fy, fixedOne - fy, fy, fixedOne - fy);
+				__m128i sum = _mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), wy);
+				sum = _mm_srai_epi32(_mm_add_epi32(sum, round), 2*fixedBits);
+				sum = _mm_packs_epi32(sum, sum);
+				int bgr = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+				dst[0] = (uchar)bgr;
+				dst[1] = (uchar)(bgr >> 8);
+				dst[2] = (uchar)(bgr >> 16);
+				continue;
+			}
+#endif
+			for (int c = 0; c < 3; c++) {
+				int top = p[c] * (fixedOne - fx) + p[c + 3] * fx;
+				int bottom = p[c + srcStep] * (fixedOne - fx) + p[c + srcStep + 3] * fx;
+				dst[c] = (uchar)((top * (fixedOne - fy) + bottom * fy + (1 << (2*fixedBits - 1))) >> (2*fixedBits));
+			}
+		}
+		if (grayImage != NULL)
+			computePlanesRow(y);
+	}
+}
@@ -42,6 +42,8 @@
 #include "util.h"
 #include "VideoCapture.h"
 
+enum { UNDISTORT_DIRECT, UNDISTORT_REMAP, UNDISTORT_FIXED_POINT };
+
 class CameraUndistort : public ImageProcessor {
 public:
 	CameraUndistort(const char *calibFilename);
@@ -49,11 +51,43 @@ public:
 	CameraUndistort(float *keyValues);
 	~CameraUndistort();
 
+	void setMethod(int method);
+	void setNumThreads(int numThreads);
+	void setFusedOutput(bool crop, int downscale, bool planes);
 	void init(IplImage *current_frame);
+	CvSize getSourceSize();
+	int getDownscale();
 	IplImage * processImage(IplImage *draw_image);
+	bool undistortPoint(double x, double y, double &undistortedX, double &undistortedY);
+	void distortPoint(double x, double y, double &distortedX, double &distortedY);
+
+	bool useSimd;   //debug. false = scalar code also with SSE2 (see benchmarkUndistort)
+
+	//fused output (see setFusedOutput)
+	IplImage *grayImage, *skyImage;   //gray and sky channel of processImage. NULL = not computed
+	CvRect cropRect;                  //the region of the full resolution undistorted image in processImage
 
 private:
+	void setDefaults();
+	void buildFixedPointMap();
+	void buildFusedMap();
+	void setFixedMapEntry(int i, double sx, double sy);
+	void computePlanesRow(int y);
+	void remapFixedPointRows(IplImage *srcImage, int y0, int y1);
+	static void remapBand(void *cameraUndistort, int bandIdx);
+
+	int method;
+	int numThreads;
+	int srcWidth, srcHeight;
+	bool fusedCrop, fusedPlanes;
+	int downscale;
+	double focalX, focalY, centerX, centerY;   //the intrinsics, and the distortion coefficients k1 k2 p1 p2
+	double k1, k2, p1, p2;
 	IplImage *  out_image;
+	IplImage *mapx, *mapy;     //source coordinates of each pixel of out_image, 32 bit float (UNDISTORT_REMAP)
+	short (*fixedMap)[2];      //integer source coordinates (UNDISTORT_FIXED_POINT)
+	ushort *fixedWeights;      //fractional source coordinates, 7 bits each: x | y << 7 (UNDISTORT_FIXED_POINT)
+	IplImage *bandSrcImage;    //argument of remapBand
     CvMat *intrinsics;
     CvMat *distortion_coeffs;
 };
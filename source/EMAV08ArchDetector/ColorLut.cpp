@@ -0,0 +1,121 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * COLOR LOOKUP TABLE
+ * The balloons of the arch are red, so instead of looking for edges in the gray image,
+ * each BGR pixel is classified (balloon or background) with a lookup table of 32x32x32 bins
+ * (the 5 most significant bits of b, g and r). segment writes the binary mask (255 = balloon),
+ * where the blob detector then looks for the round blobs.
+ *
+ * The table is built from a rule (buildRedRule, HSV thresholds at the center of each bin),
+ * or loaded from a file with the 32768 bytes of the table (e.g. trained from labeled frames).
+ * Classifying a pixel is one table lookup, cheaper than the canny edge detector.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <stdio.h>
+using namespace std;
+
+#include "util.h"
+#include "ColorLut.h"
+
+
+ColorLut::ColorLut() {
+	buildRedRule(20, 0.4, 0.25);
+}
+
+
+/*
+ * Red in HSV: the hue is within maxHueDistanceD degrees of red (0 degrees),
+ * the saturation >= minSaturation and the value >= minValue (0..1).
+ */
+bool ColorLut::isRed(int b, int g, int r, double maxHueDistanceD, double minSaturation, double minValue) {
+	int maxC = Max(r, Max(g, b));
+	int minC = Min(r, Min(g, b));
+	if (maxC != r || maxC == minC)
+		return false;   //red must be the largest component
+	double value = maxC / 255.;
+	double saturation = (double)(maxC - minC) / maxC;
+	double hueD = 60. * (g - b) / (maxC - minC);   //-60..60, 0 = red
+	return fabs(hueD) <= maxHueDistanceD && saturation >= minSaturation && value >= minValue;
+}
+
+void ColorLut::buildRedRule(double maxHueDistanceD, double minSaturation, double minValue) {
+	int half = 1 << (7 - BITS);   //center of the bin
+	for (int b = 0; b < LEVELS; b++)
+		for (int g = 0; g < LEVELS; g++)
+			for (int r = 0; r < LEVELS; r++) {
+				bool red = isRed((b << (8 - BITS)) + half, (g << (8 - BITS)) + half, (r << (8 - BITS)) + half, maxHueDistanceD, minSaturation, minValue);
+				table[(b << (2*BITS)) | (g << BITS) | r] = red ? 255 : 0;
+			}
+}
+
+void ColorLut::load(const char *filename) {
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL)
+		throw "Cannot read the color lookup table file.";
+	int read = (int)fread(table, 1, SIZE, file);
+	fclose(file);
+	if (read != SIZE)
+		throw "The color lookup table file must have 32768 bytes.";
+	for (int i = 0; i < SIZE; i++)
+		table[i] = table[i] ? 255 : 0;
+}
+
+void ColorLut::save(const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL)
+		throw "Cannot write the color lookup table file.";
+	fwrite(table, 1, SIZE, file);
+	fclose(file);
+}
+
+
+//maskImage = table(srcImage), inside roi
+void ColorLut::segment(IplImage *srcImage, IplImage *maskImage, CvRect roi) {
+	assert(srcImage->nChannels == 3);
+	assert(maskImage->nChannels == 1);
+	int srcStep = srcImage->widthStep;
+	int maskStep = maskImage->widthStep;
+	uchar *srcY = (uchar*) srcImage->imageData + roi.y*srcStep + roi.x*3;
+	uchar *maskY = (uchar*) maskImage->imageData + roi.y*maskStep + roi.x;
+	for (int y = 0; y < roi.height; y++, srcY += srcStep, maskY += maskStep) {
+		uchar *src = srcY;
+		for (int x = 0; x < roi.width; x++, src += 3)
+			maskY[x] = table[((src[0] >> (8 - BITS)) << (2*BITS)) | ((src[1] >> (8 - BITS)) << BITS) | (src[2] >> (8 - BITS))];
+	}
+}
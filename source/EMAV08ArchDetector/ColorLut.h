@@ -0,0 +1,60 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* See ColorLut.cpp for more info */
+
+
+#ifndef __COLOR_LUT_H
+#define __COLOR_LUT_H
+
+#include "util.h"
+
+class ColorLut {
+public:
+	enum { BITS = 5, LEVELS = 1 << BITS, SIZE = LEVELS * LEVELS * LEVELS };
+
+	ColorLut();
+	void buildRedRule(double maxHueDistanceD, double minSaturation, double minValue);
+	void load(const char *filename);
+	void save(const char *filename);
+	void segment(IplImage *srcImage, IplImage *maskImage, CvRect roi);
+	static bool isRed(int b, int g, int r, double maxHueDistanceD, double minSaturation, double minValue);
+
+	inline bool classify(int b, int g, int r) {
+		return table[((b >> (8 - BITS)) << (2*BITS)) | ((g >> (8 - BITS)) << BITS) | (r >> (8 - BITS))] != 0;
+	}
+
+	uchar table[SIZE];   //index = b,g,r (5 bits each). 0 = background, 255 = balloon
+};
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ 
+/*
+ * FILL AND ERODE BLOB DETECTOR
+ * The C++ version of MorphBlobDetector_alternative.m, which gave better results than MorphBlobDetector:
+ *
+ * 1. canny edges of the gray image.
+ * 2. imfill(edges, 'holes'): the background (4-connected) reachable from the image border
+ *    is flood-filled with a queue, and the rest is foreground.
+ * 3. my_erode: removes the foreground pixels with less than 3 foreground 8-neighbours, until nothing changes.
+ *    The matlab version rescans the whole image until nothing changes.
+ *    Here, the pixels with less than 3 neighbours go into a queue, and removing a pixel decrements
+ *    the count of its neighbours, which go into the queue when their count drops below 3.
+ *    Each pixel enters the queue at most once. As removing pixels only decreases the counts,
+ *    the result does not depend on the order (it is the same as the matlab version).
+ * 4. bwboundaries + regionprops: one labeling pass (8-connected, see BlobLabeler)
+ *    gives the area and centroid of each blob, the perimeter is the length of its traced boundary
+ *    (see tracePerimeter), and the blobs with roundness 4*pi*area/perimeter^2 > 0.7 are kept.
+ */
+
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "util.h"
+#include "FillErodeBlobDetector.h"
+#include "BlobLabeler.h"
+#include "CombineFrames.h"
+
+
+static const double roundnessThreshold = 0.7;   //as the matlab version
+static const int minNeighbours = 3;             //as my_erode
+static const double diagonalStep = sqrt(2.0);   //tracePerimeter
+
+
+FillErodeBlobDetector::FillErodeBlobDetector() {
+	labeler = NULL;
+	queue = NULL;
+	neighbours = NULL;
+	blobCentroid = NULL;
+}
+
+void FillErodeBlobDetector::init(IplImage *current_frame) {
+	cout << "FillErodeBlobDetector. init" << endl;
+	width = current_frame->width;
+	height = current_frame->height;
+
+	grayImage    = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	cannyImage   = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	filledImage  = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	blobsImage   = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+
+	mixedImage    = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	multipleImage = _cvCreateImage(cvSize(width*2, height), IPL_DEPTH_8U, 3);
+	temp3CImage   = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+
+	//all the buffers for the worst case, so findBlobs does not allocate memory
+	queue = new int[width * height];
+	neighbours = new uchar[width * height];
+	labeler = new BlobLabeler(width, height);
+	labeler->setFillHoles(false);   //filled by fillHoles, and erode does not open holes
+	blobCentroid = new int[width * height / 2 + 2][2];
+	numBlobs = 0;
+}
+
+
+FillErodeBlobDetector::~FillErodeBlobDetector() {
+	cvReleaseImage(&grayImage);
+	cvReleaseImage(&cannyImage);
+	cvReleaseImage(&filledImage);
+	cvReleaseImage(&blobsImage);
+	cvReleaseImage(&mixedImage);
+	cvReleaseImage(&multipleImage);
+	cvReleaseImage(&temp3CImage);
+	delete[] queue;
+	delete[] neighbours;
+	delete[] blobCentroid;
+	delete labeler;
+}
+
+
+void FillErodeBlobDetector::findBlobs(IplImage *srcImage)
+{
+	cvCvtColor (srcImage, grayImage, CV_BGR2GRAY);
+	cvCanny(grayImage, cannyImage, 100, 200);
+
+	cvCopy(cannyImage, filledImage);
+	fillHoles(filledImage);
+	erode(filledImage);
+
+	int numComponents = labeler->label(filledImage, cvRect(0, 0, width, height));
+	numBlobs = 0;
+	for (int c = 0; c < numComponents; c++) {
+		BlobComponent &blob = labeler->components[c];
+		double area = blob.pixels;
+		double perimeter = tracePerimeter(filledImage, blob.startX, blob.startY);
+		double roundnessMetric = 4 * CV_PI * area / (perimeter*perimeter);
+		blob.keep = roundnessMetric > roundnessThreshold;
+		if (blob.keep) {
+			blobCentroid[numBlobs][0] = (int)(blob.sumX / blob.pixels);
+			blobCentroid[numBlobs][1] = (int)(blob.sumY / blob.pixels);
+			numBlobs++;
+		}
+	}
+
+	cvZero(blobsImage);
+	labeler->drawComponents(blobsImage);
+}
+
+
+/*
+ * The perimeter of the matlab version: the length of the outer boundary of the blob,
+ * traced through the centers of its boundary pixels (as bwboundaries, 8-connected),
+ * with the diagonal steps counting sqrt(2).
+ * The number of boundary pixels (BlobLabeler) underestimates it, and a digital disc would score about 1.2.
+ * (startX, startY) is the first pixel of the blob in raster order.
+ *
+ * Moore neighbour tracing: from the current pixel, its 8 neighbours are checked clockwise,
+ * starting from the background pixel we came from, and the first foreground pixel is the next one.
+ * It stops when it leaves the start pixel again in the same direction as the first time.
+ * A blob of one pixel has perimeter 0 (infinite roundness, kept, as in matlab).
+ */
+double FillErodeBlobDetector::tracePerimeter(IplImage *binaryImage, int startX, int startY)
+{
+	//clockwise (y down), from W. the odd directions are diagonal
+	static const int dx[8] = {-1, -1, 0, 1, 1,  1,  0, -1};
+	static const int dy[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+	int step = binaryImage->widthStep;
+	const uchar *data = (const uchar*) binaryImage->imageData;
+
+	int x = startX, y = startY;
+	int back = 0;   //direction of the background neighbour we came from. W of the first pixel is background
+	int firstDir = -1;
+	double perimeter = 0;
+	for (;;) {
+		int dir = -1;
+		for (int i = 1; i <= 8; i++) {
+			int d = (back + i) & 7;
+			int nx = x + dx[d], ny = y + dy[d];
+			if (nx >= 0 && nx < width && ny >= 0 && ny < height && data[ny*step + nx]) {
+				dir = d;
+				break;
+			}
+		}
+		if (dir < 0)
+			return 0;   //isolated pixel
+		if (x == startX && y == startY) {
+			if (firstDir < 0)
+				firstDir = dir;
+			else if (dir == firstDir)
+				return perimeter;
+		}
+		//the neighbour checked before dir is background, seen from the next pixel
+		int prev = (dir + 7) & 7;
+		int px = x + dx[prev], py = y + dy[prev];
+		x += dx[dir];
+		y += dy[dir];
+		perimeter += (dir & 1) ? diagonalStep : 1;
+		for (back = 0; back < 8; back++)
+			if (x + dx[back] == px && y + dy[back] == py)
+				break;
+	}
+}
+
+
+/*
+ * imfill(binaryImage, 'holes'), in place.
+ * The background pixels 4-connected to the image border are marked (1) with a queue flood fill,
+ * the rest are foreground (255).
+ */
+void FillErodeBlobDetector::fillHoles(IplImage *binaryImage)
+{
+	assert(binaryImage->nChannels == 1);
+	int step = binaryImage->widthStep;
+	uchar *data = (uchar*) binaryImage->imageData;
+	int queueEnd = 0;
+
+	//the background of the border
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x += (y == 0 || y == height - 1) ? 1 : width - 1) {
+			uchar *p = data + y*step + x;
+			if (*p == 0) {
+				*p = 1;
+				queue[queueEnd++] = y*width + x;
+			}
+		}
+	}
+
+	//flood fill, 4-connected
+	for (int q = 0; q < queueEnd; q++) {
+		int x = queue[q] % width;
+		int y = queue[q] / width;
+		uchar *p = data + y*step + x;
+		if (x > 0 && p[-1] == 0) {
+			p[-1] = 1;
+			queue[queueEnd++] = queue[q] - 1;
+		}
+		if (x < width - 1 && p[1] == 0) {
+			p[1] = 1;
+			queue[queueEnd++] = queue[q] + 1;
+		}
+		if (y > 0 && p[-step] == 0) {
+			p[-step] = 1;
+			queue[queueEnd++] = queue[q] - width;
+		}
+		if (y < height - 1 && p[step] == 0) {
+			p[step] = 1;
+			queue[queueEnd++] = queue[q] + width;
+		}
+	}
+
+	//outside = 0, edges and holes = 255
+	for (int y = 0; y < height; y++) {
+		uchar *p = data + y*step;
+		for (int x = 0; x < width; x++)
+			p[x] = (p[x] == 1) ? 0 : 255;
+	}
+}
+
+
+/*
+ * my_erode(binaryImage), in place.
+ * The foreground pixels with less than minNeighbours foreground 8-neighbours are removed,
+ * until nothing changes (outside the image is background).
+ */
+void FillErodeBlobDetector::erode(IplImage *binaryImage)
+{
+	assert(binaryImage->nChannels == 1);
+	int step = binaryImage->widthStep;
+	uchar *data = (uchar*) binaryImage->imageData;
+	int queueEnd = 0;
+
+	//neighbours of each foreground pixel
+	for (int y = 0; y < height; y++) {
+		uchar *p = data + y*step;
+		uchar *n = neighbours + y*width;
+		for (int x = 0; x < width; x++) {
+			if (!p[x])
+				continue;
+			int count = 0;
+			for (int dy = -1; dy <= 1; dy++) {
+				if (y + dy < 0 || y + dy >= height)
+					continue;
+				for (int dx = -1; dx <= 1; dx++)
+					if ((dx || dy) && x + dx >= 0 && x + dx < width && p[dy*step + x + dx])
+						count++;
+			}
+			n[x] = count;
+			if (count < minNeighbours)
+				queue[queueEnd++] = y*width + x;
+		}
+	}
+
+	//remove them, and queue the neighbours that drop below minNeighbours
+	for (int q = 0; q < queueEnd; q++) {
+		int x = queue[q] % width;
+		int y = queue[q] / width;
+		data[y*step + x] = 0;
+		for (int dy = -1; dy <= 1; dy++) {
+			if (y + dy < 0 || y + dy >= height)
+				continue;
+			for (int dx = -1; dx <= 1; dx++) {
+				if ((dx || dy) && x + dx >= 0 && x + dx < width && data[(y+dy)*step + x + dx]) {
+					int i = (y+dy)*width + x + dx;
+					if (neighbours[i]-- == minNeighbours)
+						queue[queueEnd++] = i;
+				}
+			}
+		}
+	}
+}
+
+
+IplImage * FillErodeBlobDetector::processImage(IplImage *srcImage)
+{
+	findBlobs(srcImage);
+
+	//mixed image. draw blobs
+	cvCopy(srcImage, mixedImage);
+	cvCvtColor (blobsImage, temp3CImage, CV_GRAY2BGR);
+	cvCopy(temp3CImage, mixedImage, blobsImage);
+
+	//mixed image. draw blob centroids
+	for (int i = 0; i < numBlobs; i++)
+		drawSymbol(mixedImage, 1, blobCentroid[i][0], blobCentroid[i][1], CV_GREEN);
+
+	//mixed image + filled and eroded edges
+	cvCvtColor (filledImage, temp3CImage, CV_GRAY2BGR);
+	Combine2x1Frames::combine2x1(multipleImage, mixedImage, temp3CImage);
+
+	return multipleImage;
+}
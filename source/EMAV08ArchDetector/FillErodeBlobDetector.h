@@ -0,0 +1,72 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+ 
+
+/* See FillErodeBlobDetector.cpp for more info */
+
+
+#ifndef __FILL_ERODE_BLOB_DETECTOR_H
+#define __FILL_ERODE_BLOB_DETECTOR_H
+
+#include "util.h"
+#include "VideoCapture.h"
+
+class BlobLabeler;
+
+class FillErodeBlobDetector : public ImageProcessor {
+public:
+	FillErodeBlobDetector();
+	void init(IplImage *current_frame);
+	void findBlobs(IplImage *srcImage);
+	void fillHoles(IplImage *binaryImage);
+	void erode(IplImage *binaryImage);
+	IplImage * processImage(IplImage *srcImage);
+	~FillErodeBlobDetector();
+
+	int width, height;
+	IplImage *grayImage, *cannyImage, *filledImage, *blobsImage;
+	IplImage *mixedImage, *multipleImage;
+	IplImage *temp3CImage;
+
+	int numBlobs;
+	int (*blobCentroid)[2];
+
+private:
+	double tracePerimeter(IplImage *binaryImage, int startX, int startY);
+
+	int *queue;                //pixel indices, width*height
+	uchar *neighbours;         //foreground 8-neighbours of each pixel, for erode
+	BlobLabeler *labeler;
+};
+
+#endif
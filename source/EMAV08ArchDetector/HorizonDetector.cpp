@@ -41,13 +41,53 @@
  */
 
 #include <cmath>
+#include <cfloat>
 #include <cassert>
 #include <iostream>
 using namespace std;
 
 #include "util.h"
 #include "HorizonDetector.h"
+#include "Parallel.h"
 
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+static void initSkyReciprocal();
+
+
+HorizonDetector::HorizonDetector() {
+	fusedPass = true;
+	trackingBandRows = 0;
+	trackingRefreshInterval = 1;
+	trackingResyncAngleD = 0;
+	trackingValid = false;
+	rowMoments = NULL;
+	numThreads = 1;
+	bands = NULL;
+	skyInputData = NULL;
+}
+
+/*
+ * fusedPass = true (default): one pass over the image, see computeSkyChannelHistogramAndMoments.
+ * fusedPass = false: the original three passes (sky channel, cvThreshold with otsu, and the moments).
+ * Both give the same horizon.
+ */
+void HorizonDetector::setFusedPass(bool fusedPass) {
+	this->fusedPass = fusedPass;
+}
+
+/*
+ * The sky channel of the srcImage of the next computeHorizon, computed by the caller
+ * (e.g. with the undistortion, see CameraUndistort::setFusedOutput), same size as srcImage, no row padding.
+ * It is copied to grayImage (1 byte per pixel) instead of computed from the 3 bytes of srcImage.
+ * It can be set once, if the caller updates the same image for each frame. NULL (default) = computed here.
+ */
+void HorizonDetector::setSkyImage(IplImage *skyImage) {
+	assert(skyImage == NULL || (skyImage->nChannels == 1 && skyImage->widthStep == skyImage->width));
+	skyInputData = (skyImage != NULL) ? (uchar*) skyImage->imageData : NULL;
+}
 
 void HorizonDetector::init(IplImage *current_frame) {
 	cout << "HorizonDetector. init" << endl;
@@ -89,6 +129,18 @@ void HorizonDetector::init(IplImage *current_frame) {
 	*/
 
 	horizon.image = grayImage;
+
+	rowMoments = new HorizonMoments[height];
+	trackingValid = false;
+
+	//row bands, one for each thread
+	numBands = numThreads;
+	bands = new HorizonBand[numBands];
+	for (int b = 0; b < numBands; b++) {
+		bands[b].yStart = height * b / numBands;
+		bands[b].yEnd = height * (b + 1) / numBands;
+	}
+	initSkyReciprocal();   //before the threads
 }
 
 
@@ -101,87 +153,465 @@ Horizon* HorizonDetector::computeHorizon(IplImage *srcImage)
 	assert(srcChannels == 3);
 	assert(srcIwd == width*srcChannels);
 
-	//compute gray image
-	uchar *dataYX = srcData;
-	uchar *grayDataYX = grayData;
-	for (int y=0;y<height;y++) {
-		for (int x=0;x<width;x++) {
-			/*
-			int index = y*srcIwd + x*srcChannels;
-			int r = srcData[index+2];
-			int g = srcData[index+1];
-			int b = srcData[index];
-			*/
-			int b = *(dataYX++);
-			int g = *(dataYX++);
-			int r = *(dataYX++);
-
-			int sum = r + g + b;
-			int o;
-			if (sum == 0) {
-				o = 0;
-			} else {
-				o = 3 * b * b / sum;
-				if (o > 255) o = 255;
+	HorizonMoments m;
+
+	//tracking: only the rows around the previous horizon
+	if (trackingBandRows > 0 && trackingValid && framesSinceRefresh < trackingRefreshInterval
+		&& computeTrackedMoments(srcData, m)) {
+		Horizon previousHorizon = horizon;
+		computeHorizonFromMoments(m);
+		framesSinceRefresh++;
+		double angleChangeD = fmod(fabs(horizon.angleD - previousHorizon.angleD), 180);   //angleD = 0 and 180 is the same line
+		angleChangeD = min(angleChangeD, 180 - angleChangeD);
+		if (angleChangeD <= trackingResyncAngleD && abs(horizon.y0 - previousHorizon.y0) <= trackingBandRows / 2)
+			return &horizon;
+		cout << "HorizonDetector. resync" << endl;
+	}
+
+	computeMoments(srcData, m);
+	if (trackingBandRows > 0) {
+		computeRowMoments(0, height);
+		framesSinceRefresh = 0;
+		trackingValid = true;
+	}
+	computeHorizonFromMoments(m);
+
+	return &horizon;
+}
+
+//the sky and ground moments inside the circle, over the whole image
+void HorizonDetector::computeMoments(uchar *srcData, HorizonMoments &m)
+{
+	//64 bits accumulators: with an int, the sums of x and y overflow at 1080p
+	m.skyXAccum = 0;    m.skyYAccum = 0;
+	m.groundXAccum = 0; m.groundYAccum = 0;
+	m.skyPixels = 0;
+
+	if (fusedPass || trackingBandRows > 0) {
+		//gray image, histogram and the moments by gray level, in one pass (by row bands)
+		bandSrcData = srcData;
+		parallelFor(numBands, computeBand, this, numThreads);
+
+		memset(histogram, 0, sizeof(histogram));
+		memset(levelPixels, 0, sizeof(levelPixels));
+		memset(levelXAccum, 0, sizeof(levelXAccum));
+		memset(levelYAccum, 0, sizeof(levelYAccum));
+		for (int b = 0; b < numBands; b++) {
+			for (int level = 0; level < 256; level++) {
+				histogram[level]   += bands[b].histogram[level];
+				levelPixels[level] += bands[b].levelPixels[level];
+				levelXAccum[level] += bands[b].levelXAccum[level];
+				levelYAccum[level] += bands[b].levelYAccum[level];
 			}
+		}
+		threshold = otsuThreshold(histogram, width*height);
 
-			//grayData[y*width + x] = o;
-			*(grayDataYX++) = o;
+		//sky = the pixels above the threshold
+		for (int level = 0; level < 256; level++) {
+			if (level > threshold) {
+				m.skyXAccum += levelXAccum[level];
+				m.skyYAccum += levelYAccum[level];
+				m.skyPixels += levelPixels[level];
+			} else {
+				m.groundXAccum += levelXAccum[level];
+				m.groundYAccum += levelYAccum[level];
+			}
 		}
+		binaryImageValid = false;
+		return;
 	}
 
+	//three passes
+	//compute gray image
+	if (skyInputData != NULL)
+		memcpy(grayData, skyInputData, width*height);
+	else
+		computeSkyChannel(srcData, grayData, width*height);
+
 	//cout << "H2" << endl;
 	//compute black and white image
     cvThreshold(grayImage,grayImage,-1,255,CV_THRESH_BINARY+CV_THRESH_OTSU);       
 
 
 	//cout << "H3" << endl;
-	//find the sky and ground center
-	//make sure that the image is small enough to accumate the mean, or change the code
-	int skyXAccum = 0,    skyYAccum = 0;
-	int groundXAccum = 0, groundYAccum = 0;
-	int skyPixels = 0;
-	for (int y = 0; y < height; y++) {
-		int x = circleX[y][0];
-		uchar *grayDataYX = grayData + y*width + x;
-		uchar *grayDataYXMax = grayDataYX + circleX[y][1];
-		for (; grayDataYX < grayDataYXMax; x++, grayDataYX++) {
-			if (*grayDataYX) {
-				skyYAccum += y;
-				skyXAccum += x;
-				skyPixels++;
-			} else {
-				groundYAccum += y;
-				groundXAccum += x;
-			}
-		} 
+	//find the sky and ground center (by row bands)
+	bandSrcData = NULL;
+	parallelFor(numBands, computeBand, this, numThreads);
+	for (int b = 0; b < numBands; b++) {
+		m.skyXAccum    += bands[b].moments.skyXAccum;
+		m.skyYAccum    += bands[b].moments.skyYAccum;
+		m.groundXAccum += bands[b].moments.groundXAccum;
+		m.groundYAccum += bands[b].moments.groundYAccum;
+		m.skyPixels    += bands[b].moments.skyPixels;
 	}
+	binaryImageValid = true;
+}
 
+void HorizonDetector::computeHorizonFromMoments(const HorizonMoments &m)
+{
 	//cout << "H4" << endl;
-	horizon.skyX = (double)skyXAccum / skyPixels;
-	horizon.skyY = (double)skyYAccum / skyPixels;
-	int groundPixels = circlePixels - skyPixels;
-	horizon.groundX = (double)groundXAccum / groundPixels;
-	horizon.groundY = (double)groundYAccum / groundPixels;
-	//cout << "skyPixels:" << skyPixels << ", circlePixels:" << circlePixels << "groundPixels:" << groundPixels << endl;
+	horizon.skyX = (double)m.skyXAccum / m.skyPixels;
+	horizon.skyY = (double)m.skyYAccum / m.skyPixels;
+	int groundPixels = circlePixels - m.skyPixels;
+	horizon.groundX = (double)m.groundXAccum / groundPixels;
+	horizon.groundY = (double)m.groundYAccum / groundPixels;
+	//cout << "m.skyPixels:" << m.skyPixels << ", circlePixels:" << circlePixels << "groundPixels:" << groundPixels << endl;
 	cout << "skyX=" << horizon.skyX << ", skyY=" << horizon.skyY << endl;
 	cout << "groundX=" << horizon.groundX << ", groundY=" << horizon.groundY << endl;
 
 	//compute the angle
 	horizon.angleR = CV_PI/2 + atan(-(horizon.groundY - horizon.skyY) / (horizon.groundX - horizon.skyX));
 	horizon.angleD = horizon.angleR * 180 / CV_PI;
-	double prop = (double)skyPixels / (skyPixels + groundPixels);
+	double prop = (double)m.skyPixels / (m.skyPixels + groundPixels);
 	horizon.x0 = (int)(horizon.skyX + (horizon.groundX-horizon.skyX) * prop);
 	horizon.y0 = (int)(horizon.skyY + (horizon.groundY-horizon.skyY) * prop);
 	horizon.a = tan(horizon.angleR);
 	horizon.b = (height-horizon.y0) - horizon.a*horizon.x0;
 	cout << "angleR=" << horizon.angleR << ", angleD=" << horizon.angleD << ", a=" << horizon.a << ", b=" << horizon.b << endl;
+}
 
-	return &horizon;
+/*
+ * TRACKING
+ * Frame to frame, the horizon moves only a little.
+ * The rows far from the previous horizon line are all sky or all ground, and their moments do not change.
+ * So, rowMoments keeps the moments of each row (inside the circle, with the otsu threshold of the last full pass),
+ * and a tracked frame only recomputes the sky channel and the moments of the rows
+ * within trackingBandRows of the previous horizon line.
+ * The otsu threshold is kept from the last full pass.
+ *
+ * A full pass is done every trackingRefreshInterval frames,
+ * or if the horizon changes more than trackingResyncAngleD degrees or trackingBandRows/2 rows (resync),
+ * or if the band would be the whole image.
+ * In tracked frames, grayImage (showImage) is only updated within the band.
+ */
+void HorizonDetector::setTracking(int bandRows, int refreshInterval, double resyncAngleD) {
+	assert(bandRows >= 0);
+	assert(refreshInterval >= 1);
+	trackingBandRows = bandRows;
+	trackingRefreshInterval = refreshInterval;
+	trackingResyncAngleD = resyncAngleD;
+	trackingValid = false;
+}
+
+bool HorizonDetector::computeTrackedMoments(uchar *srcData, HorizonMoments &m)
+{
+	//the previous horizon line, y = y0 - a*(x - x0), between x = 0 and x = width-1
+	if (!(fabs(horizon.a) < height))
+		return false;
+	double yLeft  = horizon.y0 + horizon.a * horizon.x0;
+	double yRight = horizon.y0 - horizon.a * (width - 1 - horizon.x0);
+	int yStart = Max(0, (int)floor(min(yLeft, yRight)) - trackingBandRows);
+	int yEnd   = Min(height, (int)ceil(max(yLeft, yRight)) + trackingBandRows + 1);
+	if (yStart >= yEnd || (yEnd - yStart) * 2 > height)
+		return false;
+
+	for (int y = yStart; y < yEnd; y++) {
+		int offset = y*width + circleX[y][0];
+		if (skyInputData != NULL)
+			memcpy(grayData + offset, skyInputData + offset, circleX[y][1]);
+		else
+			computeSkyChannel(srcData + offset*3, grayData + offset, circleX[y][1]);
+	}
+	computeRowMoments(yStart, yEnd);
+	binaryImageValid = false;
+
+	m.skyXAccum = 0;    m.skyYAccum = 0;
+	m.groundXAccum = 0; m.groundYAccum = 0;
+	m.skyPixels = 0;
+	for (int y = 0; y < height; y++) {
+		m.skyXAccum    += rowMoments[y].skyXAccum;
+		m.skyYAccum    += rowMoments[y].skyYAccum;
+		m.groundXAccum += rowMoments[y].groundXAccum;
+		m.groundYAccum += rowMoments[y].groundYAccum;
+		m.skyPixels    += rowMoments[y].skyPixels;
+	}
+	return true;
 }
 
+//rowMoments of the rows yStart..yEnd-1, from the sky channel in grayImage and the otsu threshold
+void HorizonDetector::computeRowMoments(int yStart, int yEnd)
+{
+	for (int y = yStart; y < yEnd; y++) {
+		HorizonMoments &r = rowMoments[y];
+		r.skyXAccum = 0;    r.skyYAccum = 0;
+		r.groundXAccum = 0; r.groundYAccum = 0;
+		r.skyPixels = 0;
+		int x = circleX[y][0];
+		uchar *grayDataYX = grayData + y*width + x;
+		uchar *grayDataYXMax = grayDataYX + circleX[y][1];
+		for (; grayDataYX < grayDataYXMax; x++, grayDataYX++) {
+			if (*grayDataYX > threshold) {
+				r.skyXAccum += x;
+				r.skyPixels++;
+			} else {
+				r.groundXAccum += x;
+			}
+		}
+		r.skyYAccum = r.skyPixels * y;
+		r.groundYAccum = (circleX[y][1] - r.skyPixels) * y;
+	}
+}
+
+/*
+ * SKY CHANNEL
+ * o = min(255, 3*b*b/(r+g+b)), for each pixel.
+ *
+ * The integer division is replaced by a multiplication with a reciprocal from a table,
+ * skyReciprocal[sum] = ceil(2^31/sum), sum = 1..765:
+ *   3*b*b/sum = (3*b*b * skyReciprocal[sum]) >> 31
+ * This is exact (the same as the division) because 3*b*b < 2^18 and sum < 2^10,
+ * so the error of the reciprocal, 3*b*b*(sum-1) < 2^31, never reaches the next integer.
+ * (checked for all the combinations of b and sum by the benchmark "-bench horizon")
+ *
+ * With SSE2, 32 pixels at once: the BGR bytes are deinterleaved with unpacks (see deinterleaveBgr),
+ * and the division is a float division (4 lanes). It is also exact: 3*b*b < 2^24 and sum are exact floats,
+ * the division is correctly rounded, and a quotient q < 256 which is not an integer is at least
+ * 1/sum >= 1/765 below the next integer, much more than its rounding error (q * 2^-24 < 2^-16),
+ * so truncating it gives floor(q). The larger quotients saturate to 255 when packed.
+ * The remaining pixels (and the builds without SSE2, e.g. ppc) use the reciprocal table.
+ */
+static unsigned int skyReciprocal[3*255 + 1];
+static bool skyReciprocalInited = false;
+
+static void initSkyReciprocal() {
+	if (skyReciprocalInited)
+		return;
+	skyReciprocal[0] = 0;    //sum = 0 implies b = 0, so o = 0
+	for (int sum = 1; sum <= 3*255; sum++)
+		skyReciprocal[sum] = (unsigned int)((((uint64)1 << 31) + sum - 1) / sum);
+	skyReciprocalInited = true;
+}
+
+static inline unsigned int skyValue(uchar *bgr) {
+	unsigned int b = bgr[0];
+	unsigned int sum = b + bgr[1] + bgr[2];
+	unsigned int o = (unsigned int)(((uint64)(3 * b * b) * skyReciprocal[sum]) >> 31);
+	return (o > 255) ? 255 : o;
+}
+
+//the reciprocal table only (the scalar code of computeSkyChannel)
+void computeSkyChannelScalar(uchar *bgrData, uchar *skyData, int numPixels) {
+	initSkyReciprocal();
+
+	uchar *skyDataMax = skyData + numPixels;
+	for (; skyData < skyDataMax; skyData++, bgrData += 3)
+		*skyData = skyValue(bgrData);
+}
+
+#ifdef HAVE_SSE2
+/*
+ * v = 96 bytes of BGR (32 pixels), in memory order.
+ * Afterwards, v[0], v[1] = b of the pixels 0..15, 16..31, v[2], v[3] = g, v[4], v[5] = r.
+ * Each layer interleaves (v0, v3), (v1, v4), (v2, v5). After 5 layers the bytes are in channel order.
+ */
+static inline void deinterleaveBgr(__m128i *v) {
+	for (int layer = 0; layer < 5; layer++) {
+		__m128i t0 = _mm_unpacklo_epi8(v[0], v[3]);
+		__m128i t1 = _mm_unpackhi_epi8(v[0], v[3]);
+		__m128i t2 = _mm_unpacklo_epi8(v[1], v[4]);
+		__m128i t3 = _mm_unpackhi_epi8(v[1], v[4]);
+		__m128i t4 = _mm_unpacklo_epi8(v[2], v[5]);
+		__m128i t5 = _mm_unpackhi_epi8(v[2], v[5]);
+		v[0] = t0; v[1] = t1; v[2] = t2; v[3] = t3; v[4] = t4; v[5] = t5;
+	}
+}
+
+//3*b*b/sum of 4 pixels (32 bit lanes), truncated
+static inline __m128i skyQuotient4(__m128i b, __m128i sum) {
+	__m128 fb = _mm_cvtepi32_ps(b);
+	__m128 numerator = _mm_mul_ps(_mm_mul_ps(fb, fb), _mm_set1_ps(3.0f));
+	__m128 denominator = _mm_max_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(1.0f));   //sum = 0 implies b = 0: 0/1
+	return _mm_cvttps_epi32(_mm_div_ps(numerator, denominator));
+}
+
+//sky values of 8 pixels, b and sum in 16 bit lanes. the result (16 bit lanes) is saturated to 32767
+static inline __m128i skyValues8(__m128i b, __m128i sum) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = skyQuotient4(_mm_unpacklo_epi16(b, zero), _mm_unpacklo_epi16(sum, zero));
+	__m128i hi = skyQuotient4(_mm_unpackhi_epi16(b, zero), _mm_unpackhi_epi16(sum, zero));
+	return _mm_packs_epi32(lo, hi);
+}
+
+//sky values of 16 pixels, b, g, r in bytes
+static inline __m128i skyValues16(__m128i b, __m128i g, __m128i r) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i bLo = _mm_unpacklo_epi8(b, zero), bHi = _mm_unpackhi_epi8(b, zero);
+	__m128i sumLo = _mm_add_epi16(_mm_add_epi16(bLo, _mm_unpacklo_epi8(g, zero)), _mm_unpacklo_epi8(r, zero));
+	__m128i sumHi = _mm_add_epi16(_mm_add_epi16(bHi, _mm_unpackhi_epi8(g, zero)), _mm_unpackhi_epi8(r, zero));
+	return _mm_packus_epi16(skyValues8(bLo, sumLo), skyValues8(bHi, sumHi));   //min(255, o)
+}
+#endif
+
+void computeSkyChannel(uchar *bgrData, uchar *skyData, int numPixels) {
+	int i = 0;
+#ifdef HAVE_SSE2
+	for (; i + 32 <= numPixels; i += 32, bgrData += 96, skyData += 32) {
+		__m128i v[6];
+		for (int k = 0; k < 6; k++)
+			v[k] = _mm_loadu_si128((const __m128i*)(bgrData + 16*k));
+		deinterleaveBgr(v);
+		_mm_storeu_si128((__m128i*)skyData, skyValues16(v[0], v[2], v[4]));
+		_mm_storeu_si128((__m128i*)(skyData + 16), skyValues16(v[1], v[3], v[5]));
+	}
+#endif
+	computeSkyChannelScalar(bgrData, skyData, numPixels - i);
+}
+
+/*
+ * FUSED PASS
+ * In one pass over the image, computes the sky channel (grayImage),
+ * its histogram (whole image, for the otsu threshold),
+ * and for each gray level, the number of pixels and the sum of x and y inside the circle.
+ * Then, the sky and ground centers for any threshold are just sums over the gray levels,
+ * and the black and white image is only needed for showImage.
+ * With setSkyImage, the band of the sky channel is copied first, and the pass only reads it.
+ * Otherwise, the sky channel of each row is computed first (computeSkyChannel, still in the cache).
+ */
+void HorizonDetector::computeSkyChannelHistogramAndMoments(uchar *srcData, HorizonBand &band) {
+	int *histogram = band.histogram;
+	int *levelPixels = band.levelPixels;
+	int64 *levelXAccum = band.levelXAccum;
+	int64 *levelYAccum = band.levelYAccum;
+	memset(histogram, 0, sizeof(band.histogram));
+	memset(levelPixels, 0, sizeof(band.levelPixels));
+	memset(levelXAccum, 0, sizeof(band.levelXAccum));
+	memset(levelYAccum, 0, sizeof(band.levelYAccum));
+
+	uchar *sky = grayData + band.yStart*width;
+	bool skyReady = (skyInputData != NULL);
+	if (skyReady)
+		memcpy(sky, skyInputData + band.yStart*width, (band.yEnd - band.yStart)*width);
+	for (int y = band.yStart; y < band.yEnd; y++) {
+		if (!skyReady)
+			computeSkyChannel(srcData + y*width*3, sky, width);
+		int circleStartX = circleX[y][0];
+		int circleEndX = circleStartX + circleX[y][1];
+		int x = 0;
+		for (; x < circleStartX; x++, sky++)
+			histogram[*sky]++;
+		for (; x < circleEndX; x++, sky++) {
+			unsigned int o = *sky;
+			histogram[o]++;
+			levelPixels[o]++;
+			levelXAccum[o] += x;
+			levelYAccum[o] += y;
+		}
+		for (; x < width; x++, sky++)
+			histogram[*sky]++;
+	}
+}
+
+//the moments of the black and white image (three passes), rows yStart..yEnd-1
+void HorizonDetector::computeBinaryMoments(HorizonBand &band) {
+	HorizonMoments &m = band.moments;
+	m.skyXAccum = 0;    m.skyYAccum = 0;
+	m.groundXAccum = 0; m.groundYAccum = 0;
+	m.skyPixels = 0;
+	for (int y = band.yStart; y < band.yEnd; y++) {
+		int x = circleX[y][0];
+		uchar *grayDataYX = grayData + y*width + x;
+		uchar *grayDataYXMax = grayDataYX + circleX[y][1];
+		for (; grayDataYX < grayDataYXMax; x++, grayDataYX++) {
+			if (*grayDataYX) {
+				m.skyYAccum += y;
+				m.skyXAccum += x;
+				m.skyPixels++;
+			} else {
+				m.groundYAccum += y;
+				m.groundXAccum += x;
+			}
+		} 
+	}
+}
+
+/*
+ * ROW BANDS
+ * The image is split in numBands bands of rows, and each band is computed by a thread (see parallelFor),
+ * with its own accumulators. The caller adds the accumulators of the bands.
+ * The sums are of integers, so the result is identical for any number of threads.
+ * bandSrcData != NULL: fused pass of the source image. bandSrcData == NULL: moments of the black and white image.
+ */
+void HorizonDetector::computeBand(void *horizonDetector, int bandIdx) {
+	HorizonDetector *detector = (HorizonDetector *)horizonDetector;
+	HorizonBand &band = detector->bands[bandIdx];
+	if (detector->bandSrcData != NULL)
+		detector->computeSkyChannelHistogramAndMoments(detector->bandSrcData, band);
+	else
+		detector->computeBinaryMoments(band);
+}
+
+/*
+ * Number of threads for the row bands (call it before init).
+ * Default = 1, all in the calling thread.
+ */
+void HorizonDetector::setNumThreads(int numThreads) {
+	assert(numThreads >= 1);
+	this->numThreads = numThreads;
+}
+
+/*
+ * Otsu threshold of a 256 bins histogram.
+ * Same computation as cvThreshold with CV_THRESH_OTSU, so that both give the same threshold.
+ * The black and white image is then (gray > threshold).
+ */
+int otsuThreshold(int *histogram, int numPixels) {
+	double mu = 0, scale = 1. / numPixels;
+	for (int i = 0; i < 256; i++)
+		mu += i * (double)histogram[i];
+	mu *= scale;
+
+	double mu1 = 0, q1 = 0;
+	double maxSigma = 0;
+	int maxVal = 0;
+	for (int i = 0; i < 256; i++) {
+		double p_i = histogram[i] * scale;
+		mu1 *= q1;
+		q1 += p_i;
+		double q2 = 1. - q1;
+		if (min(q1, q2) < FLT_EPSILON || max(q1, q2) > 1. - FLT_EPSILON)
+			continue;
+		mu1 = (mu1 + i * p_i) / q1;
+		double mu2 = (mu - q1 * mu1) / q2;
+		double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+		if (sigma > maxSigma) {
+			maxSigma = sigma;
+			maxVal = i;
+		}
+	}
+	return maxVal;
+}
+
+
+//the original implementation, with one integer division per pixel
+void computeSkyChannelReference(uchar *bgrData, uchar *skyData, int numPixels) {
+	uchar *dataYX = bgrData;
+	uchar *grayDataYX = skyData;
+	for (int i = 0; i < numPixels; i++) {
+		int b = *(dataYX++);
+		int g = *(dataYX++);
+		int r = *(dataYX++);
+
+		int sum = r + g + b;
+		int o;
+		if (sum == 0) {
+			o = 0;
+		} else {
+			o = 3 * b * b / sum;
+			if (o > 255) o = 255;
+		}
+		*(grayDataYX++) = o;
+	}
+}
+
+
 IplImage * HorizonDetector::showImage()
 {
+	//compute black and white image, if the fused pass did not
+	if (!binaryImageValid) {
+		cvThreshold(grayImage, grayImage, threshold, 255, CV_THRESH_BINARY);
+		binaryImageValid = true;
+	}
+
 	//put black pixels outside the circle
 	uchar *grayDataY = grayData;
 	for (int y = 0; y < height; y++, grayDataY += width) {
@@ -229,4 +659,6 @@ HorizonDetector::~HorizonDetector() {
 	cvReleaseImage(&horizonImage);
 
 	delete[] circleX;
+	delete[] rowMoments;
+	delete[] bands;
 }
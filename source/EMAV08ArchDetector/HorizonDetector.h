@@ -53,10 +53,36 @@ struct Horizon {
 };
 
 
-class HorizonDetector : public ImageProcessor {
+//sky channel, o = min(255, 3*b*b/(r+g+b)), for numPixels BGR pixels
+void computeSkyChannel(uchar *bgrData, uchar *skyData, int numPixels);
+void computeSkyChannelScalar(uchar *bgrData, uchar *skyData, int numPixels);
+void computeSkyChannelReference(uchar *bgrData, uchar *skyData, int numPixels);
+int otsuThreshold(int *histogram, int numPixels);
+
+
+/*
+ * Where the ArchDetector takes the horizon from, for each frame:
+ * the image (HorizonDetector) or the attitude telemetry (TelemetryHorizonSource).
+ */
+class HorizonSource {
+public:
+	virtual void init(IplImage *current_frame) = 0;
+	virtual Horizon * getHorizon(IplImage *srcImage) = 0;
+	virtual IplImage * showImage() = 0;
+	virtual ~HorizonSource() {}
+};
+
+
+class HorizonDetector : public ImageProcessor, public HorizonSource {
 public:
+	HorizonDetector();
+	void setFusedPass(bool fusedPass);
+	void setTracking(int bandRows, int refreshInterval, double resyncAngleD);
+	void setNumThreads(int numThreads);
+	void setSkyImage(IplImage *skyImage);
 	void init(IplImage *current_frame);
 	Horizon * computeHorizon(IplImage *srcImage);
+	Horizon * getHorizon(IplImage *srcImage) { return computeHorizon(srcImage); }
 	IplImage * showImage();
 	IplImage * processImage(IplImage *srcImage);
 	~HorizonDetector();
@@ -70,6 +96,50 @@ private:
 
 	int (*circleX)[2];  //this is the awkward syntax in C++ for later having circleX = new int[height][2];
 	int circlePixels;
+
+	//moments inside the circle
+	struct HorizonMoments {
+		int64 skyXAccum, skyYAccum;
+		int64 groundXAccum, groundYAccum;
+		int skyPixels;
+	};
+	void computeMoments(uchar *srcData, HorizonMoments &m);
+	void computeHorizonFromMoments(const HorizonMoments &m);
+
+	//row bands, each one computed by a thread (see computeBand)
+	struct HorizonBand {
+		int yStart, yEnd;
+		int histogram[256];
+		int levelPixels[256];
+		int64 levelXAccum[256], levelYAccum[256];
+		HorizonMoments moments;
+	};
+	static void computeBand(void *horizonDetector, int bandIdx);
+	void computeBinaryMoments(HorizonBand &band);
+	int numThreads;
+	int numBands;
+	HorizonBand *bands;
+	uchar *bandSrcData;   //NULL = moments of the black and white image
+	uchar *skyInputData;  //not owned. NULL = the sky channel is computed from srcImage (see setSkyImage)
+
+	//fused pass (see computeSkyChannelHistogramAndMoments)
+	void computeSkyChannelHistogramAndMoments(uchar *srcData, HorizonBand &band);
+	bool fusedPass;
+	bool binaryImageValid;    //grayImage has the black and white image, not the sky channel
+	int threshold;
+	int histogram[256];
+	int levelPixels[256];     //inside the circle
+	int64 levelXAccum[256], levelYAccum[256];
+
+	//tracking (see setTracking)
+	bool computeTrackedMoments(uchar *srcData, HorizonMoments &m);
+	void computeRowMoments(int yStart, int yEnd);
+	int trackingBandRows;        //0 = disabled
+	int trackingRefreshInterval;
+	double trackingResyncAngleD;
+	int framesSinceRefresh;
+	bool trackingValid;
+	HorizonMoments *rowMoments;  //rowMoments[y], for each row
 };
 
 #endif
@@ -59,11 +59,11 @@ void LineHoughTransform::init(int width, int height, double thetaResolutionDegre
     int thetaLenL = (int) (1 + ceil(90 / thetaResolutionDegrees)); 	
 	thetaLen = thetaLenL + thetaLenL -1 -1;
 	cout << "thetaResolutionDegrees:" << thetaResolutionDegrees << ", thetaLen:" << thetaLen << endl;
+	//the linspace already covers both halves, (-90 .. 90-thetaResolution).
+	//(the mirrored second half was written past the end of the array)
 	theta = new double[thetaLen];
 	for (int tIndex = 0; tIndex < thetaLen; tIndex++)
 		theta[tIndex] = tIndex * (0 - -CV_PI/2) / (thetaLenL-1) + -CV_PI/2;
-	for (int tIndex = 1; tIndex < thetaLen-1; tIndex++)
-		theta[tIndex+thetaLen] = -theta[thetaLenL - tIndex];
 
 
 	//D = sqrt((height - 1)^2 + (width - 1)^2);
@@ -115,6 +115,9 @@ void LineHoughTransform::precomputeTables() {
 	Hptr = H->data.ptr;
 	Hstep = H->step;
 
+	decayPerFrame = 0;
+	Hdecayed = NULL;
+
     firstRho = rho[0];
 
     // Precompute the sin and cos table
@@ -159,6 +162,21 @@ int LineHoughTransform::getRhoIdx(int thetaIdx, int x, int y) {
 }
 
 
+/* Given an angle in radians, find the nearest thetaIdx.
+ */
+int LineHoughTransform::getThetaIdxOf(double theta) {
+	int thetaIdx = (int) ((theta - this->theta[0]) * (thetaLen - 1) / (this->theta[thetaLen-1] - this->theta[0]) + 0.5);
+	return Max(0, Min(thetaLen-1, thetaIdx));
+}
+
+/* Given a distance rho, find the nearest rhoIdx.
+ */
+int LineHoughTransform::getRhoIdxOf(double rho) {
+	int rhoIdx = (int) (slope * (rho - firstRho) + 0.5);
+	return Max(0, Min(rhoLen-1, rhoIdx));
+}
+
+
 void LineHoughTransform::computeHough(int (*points)[2], int numPoints)
 {
 	cvZero(H);
@@ -179,6 +197,70 @@ void LineHoughTransform::computeHough(int (*points)[2], int numPoints)
 			//cout << "thetaIdx:" << thetaIdx << ", rhoIdx:" << rhoIdx << endl;
         }
     }   
+
+	if (decayPerFrame > 0)
+		accumulateDecayedHough();
+}
+
+
+/*
+ * TEMPORAL DECAY
+ * Instead of the hough transform of the last set of points,
+ * H is the weighted mean of the hough transforms of all the previous calls to computeHough,
+ * with weights decaying exponentially with the number of frames since each call (halfLifeFrames).
+ * Call skipFrame() for each frame without a call to computeHough (e.g. the blob detector did not run),
+ * so that the evidence persists between detections, and the newer detections weight more.
+ * Call it after init.
+ */
+void LineHoughTransform::setTemporalDecay(double halfLifeFrames) {
+	assert(halfLifeFrames > 0);
+	decayPerFrame = pow(0.5, 1 / halfLifeFrames);
+	if (Hdecayed == NULL)
+		Hdecayed = cvCreateMat(rhoLen, thetaLen, CV_32FC1);
+	cvZero(Hdecayed);
+	decayedWeight = 0;
+	framesSinceHough = 0;
+}
+
+void LineHoughTransform::skipFrame() {
+	framesSinceHough++;
+}
+
+// Hdecayed = decay * Hdecayed + H, and H = Hdecayed / (sum of weights)
+void LineHoughTransform::accumulateDecayedHough() {
+	double decay = pow(decayPerFrame, framesSinceHough + 1);
+	decayedWeight = decay * decayedWeight + 1;
+	for (int rhoIdx = 0; rhoIdx < rhoLen; rhoIdx++) {
+		int *Hrow = (int*)(Hptr + Hstep * rhoIdx);
+		float *HdecayedRow = (float*)(Hdecayed->data.ptr + Hdecayed->step * rhoIdx);
+		for (int thetaIdx = 0; thetaIdx < thetaLen; thetaIdx++) {
+			HdecayedRow[thetaIdx] = (float)(decay * HdecayedRow[thetaIdx] + Hrow[thetaIdx]);
+			Hrow[thetaIdx] = (int)(HdecayedRow[thetaIdx] / decayedWeight + 0.5);
+		}
+	}
+	framesSinceHough = 0;
+}
+
+
+/* Same as computeHough, but only for the columns thetaIdxMin..thetaIdxMax of H.
+ * The other columns of H are not valid afterwards.
+ * Used to compute a fine hough transform only around a given angle.
+ */
+void LineHoughTransform::computeHough(int (*points)[2], int numPoints, int thetaIdxMin, int thetaIdxMax)
+{
+	for (int rhoIdx = 0; rhoIdx < rhoLen; rhoIdx++) {
+		int *Hrow = (int*)(Hptr + Hstep * rhoIdx);
+		for (int thetaIdx = thetaIdxMin; thetaIdx <= thetaIdxMax; thetaIdx++)
+			Hrow[thetaIdx] = 0;
+	}
+
+	for(int pointIndex = 0; pointIndex < numPoints; pointIndex++) {
+		for(int thetaIdx = thetaIdxMin; thetaIdx <= thetaIdxMax; thetaIdx++) {
+			double rho = points[pointIndex][0] * cost[thetaIdx] + points[pointIndex][1] * sint[thetaIdx];
+			int rhoIdx = (int) (slope * (rho - firstRho) + 0.5);
+			((int*)(Hptr + Hstep * rhoIdx))[thetaIdx]++;
+		}
+	}
 }
 
 
@@ -191,4 +273,6 @@ LineHoughTransform::~LineHoughTransform() {
 	delete rhoIdxMin;
 	delete rhoIdxMax;
 	cvReleaseMat(&H);
+	if (Hdecayed)
+		cvReleaseMat(&Hdecayed);
 }
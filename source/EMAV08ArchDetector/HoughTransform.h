@@ -46,7 +46,12 @@ public:
 	void init(int width, int height, double thetaResolutionDegrees, double rhoResolution);
 	void init(double *rho, int rhoLen, double *theta, int thetaLen);
 	void computeHough(int (*points)[2], int numPoints);
+	void computeHough(int (*points)[2], int numPoints, int thetaIdxMin, int thetaIdxMax);
 	int getRhoIdx(int thetaIdx, int x, int y);
+	int getThetaIdxOf(double theta);
+	int getRhoIdxOf(double rho);
+	void setTemporalDecay(double halfLifeFrames);
+	void skipFrame();
 	~LineHoughTransform();
 
 	inline int getHAt(int thetaIdx, int rhoIdx) {
@@ -64,6 +69,120 @@ public:
 	CvMat* H;
 	uchar *Hptr;
 	int Hstep;
+
+private:
+	void accumulateDecayedHough();
+
+	//temporal decay (see setTemporalDecay)
+	double decayPerFrame;     //0 = no temporal decay
+	CvMat *Hdecayed;
+	double decayedWeight;
+	int framesSinceHough;
+};
+
+
+
+/*
+ * Same as LineHoughTransform, but the geometry is known at compile time.
+ * Width, Height in pixels, ThetaRes in degrees, RhoRes in pixels.
+ * AccumT is the type of the accumulator H (int, unsigned char, ...)
+ *
+ * The sizes of the tables are computed at compile time, and the tables and H are stored inline (no heap).
+ * The voting loop is fully unrolled over theta.
+ * For a point inside the image, |rho| <= D <= Q*RhoRes, so rhoIdx is always inside H.
+ * It gives exactly the same H as LineHoughTransform::init(Width, Height, ThetaRes, RhoRes).
+ */
+
+#define HOUGH_STATIC_CHECK(expr, msg) typedef char HOUGH_STATIC_CHECK_##msg[(expr) ? 1 : -1]
+
+//smallest s such that s*s >= N, computed at compile time by binary search.
+template <bool Cond, class A, class B> struct HoughIfThenElse { typedef A type; };
+template <class A, class B> struct HoughIfThenElse<false, A, B> { typedef B type; };
+
+template <int N, int Lo = 0, int Hi = 46340> struct HoughCeilSqrt {
+	enum { Mid = (Lo + Hi) / 2 };
+	enum { value = HoughIfThenElse<(Mid * Mid >= N), HoughCeilSqrt<N, Lo, Mid>, HoughCeilSqrt<N, Mid + 1, Hi> >::type::value };
+};
+template <int N, int X> struct HoughCeilSqrt<N, X, X> {
+	enum { value = X };
+};
+
+//Idx, checked at compile time to be in [0, Len) (at class scope, so that the check is not an unused local typedef)
+template <int Idx, int Len> struct HoughCheckedIndex {
+	HOUGH_STATIC_CHECK(Idx >= 0 && Idx < Len, index_out_of_range);
+	enum { value = Idx };
+};
+
+//votes the point (x, y) for ThetaIdx, ThetaIdx+1, ..., ThetaLen-1
+template <class HT, int ThetaIdx, int ThetaLen> struct HoughVoteUnroll {
+	static inline void vote(HT &h, int x, int y) {
+		h.vote(ThetaIdx, x, y);
+		HoughVoteUnroll<HT, ThetaIdx + 1, ThetaLen>::vote(h, x, y);
+	}
+};
+template <class HT, int ThetaLen> struct HoughVoteUnroll<HT, ThetaLen, ThetaLen> {
+	static inline void vote(HT &, int, int) {}
+};
+
+
+template <int Width, int Height, int ThetaRes, int RhoRes, class AccumT = int>
+class LineHoughTransformT {
+public:
+	enum {
+		D2        = (Width - 1) * (Width - 1) + (Height - 1) * (Height - 1),
+		ThetaLenL = 1 + (90 + ThetaRes - 1) / ThetaRes,    //1 + ceil(90/thetaResolutionDegrees)
+		ThetaLen  = 2 * ThetaLenL - 2,
+		Q         = (HoughCeilSqrt<D2>::value + RhoRes - 1) / RhoRes,   //ceil(D/rhoResolution)
+		RhoLen    = 2 * Q - 1
+	};
+	HOUGH_STATIC_CHECK(Width > 1 && Height > 1, image_too_small);
+	HOUGH_STATIC_CHECK(Width <= 32768 && Height <= 32768 && D2 <= 46340 * 46340, image_too_big);
+	HOUGH_STATIC_CHECK(ThetaRes >= 1 && ThetaRes <= 90, theta_resolution_out_of_range);
+	HOUGH_STATIC_CHECK(RhoRes >= 1, rho_resolution_out_of_range);
+	HOUGH_STATIC_CHECK(Q * RhoRes >= HoughCeilSqrt<D2>::value, rho_table_does_not_cover_the_image);
+
+	LineHoughTransformT() {
+		for (int tIndex = 0; tIndex < ThetaLen; tIndex++) {
+			theta[tIndex] = tIndex * (0 - -CV_PI/2) / (ThetaLenL-1) + -CV_PI/2;
+			cost[tIndex] = cos(theta[tIndex]);
+			sint[tIndex] = sin(theta[tIndex]);
+		}
+		for (int rIndex = 0; rIndex < RhoLen; rIndex++)
+			rho[rIndex] = rIndex * ((double)Q * RhoRes - -(double)Q * RhoRes) / (RhoLen-1) + -(double)Q * RhoRes;
+		firstRho = rho[0];
+		slope = (RhoLen - 1)/(rho[RhoLen-1] - firstRho);
+	}
+
+	void computeHough(int (*points)[2], int numPoints) {
+		memset(H, 0, sizeof(H));
+		for (int pointIndex = 0; pointIndex < numPoints; pointIndex++) {
+			assert(points[pointIndex][0] >= 0 && points[pointIndex][0] < Width);
+			assert(points[pointIndex][1] >= 0 && points[pointIndex][1] < Height);
+			HoughVoteUnroll<LineHoughTransformT, 0, ThetaLen>::vote(*this, points[pointIndex][0], points[pointIndex][1]);
+		}
+	}
+
+	inline void vote(int thetaIdx, int x, int y) {
+		// x*cos(theta)+y*sin(theta)=rho
+		double rho = x * cost[thetaIdx] + y * sint[thetaIdx];
+		int rhoIdx = (int) (slope * (rho - firstRho) + 0.5);
+		H[rhoIdx][thetaIdx]++;
+	}
+
+	inline int getHAt(int thetaIdx, int rhoIdx) const {
+		return H[rhoIdx][thetaIdx];
+	}
+
+	//same as getHAt, with the indices checked at compile time
+	template <int ThetaIdx, int RhoIdx> inline int getH() const {
+		return H[HoughCheckedIndex<RhoIdx, RhoLen>::value][HoughCheckedIndex<ThetaIdx, ThetaLen>::value];
+	}
+
+	double theta[ThetaLen];
+	double cost[ThetaLen], sint[ThetaLen];
+	double rho[RhoLen];
+	double firstRho, slope;
+	AccumT H[RhoLen][ThetaLen];
 };
 
 #endif
@@ -42,14 +42,185 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
 #include <iostream>
 using namespace std;
 
 #include "util.h"
 #include "MorphBlobDetector.h"
+#include "BlobLabeler.h"
+#include "ColorLut.h"
+#include "TileChangeDetector.h"
+#include "SobelEdgeDetector.h"
 #include "CombineFrames.h"
+#include "Parallel.h"
 
 
+//const double roundnessThreshold = 0.1;
+static const double roundnessThreshold = 0.05;
+
+//adaptive canny. sobel 3x3 L1 gradient magnitude (as cvCanny), 0..2*4*255
+static const int gradientLevels = 2041;
+static const double minEdgeFraction = 0.002, maxEdgeFraction = 0.3;
+
+//tile parallel front end. the tiles have at least minTileRows rows,
+//and canny is computed with tileOverlapRows more rows above and below each tile
+static const int minTileRows = 32;
+static const int tileOverlapRows = 16;
+static const int maxTiles = 64;   //the threads of parallelFor (its workers and the calling thread)
+
+/*
+ * A horizontal band of the roi, processed by a worker thread (see setNumThreads).
+ * buffer row 0 is the image row bufferY.
+ */
+struct BlobTile {
+	int yStart, yEnd;          //rows of the tile, image coordinates
+	IplImage *grayBuffer, *buffer;
+	SobelEdgeDetector *sobel;  //SEGMENT_SOBEL*
+	int bufferY;
+	CvMemStorage *storage;
+	CvSeq *contour;            //the external contours not touching the seams, relative to roi
+	int numContours;
+	int seamTopEnd;            //last row + 1 of the contours touching the seam above (yStart if none)
+	int seamBottomStart;       //first row of the contours touching the seam below (yEnd if none)
+};
+
+//change detection. the dirty tiles are dilated by one tile, and grouped in at most maxDirtyRegions regions
+static const int dirtyMarginTiles = 1;
+static const int maxDirtyRegions = 8;
+
+//the buffers of findBlobs grow only during the first frames, to headroom times the most used (see endFrame)
+static const int allocationWarmupFrames = 10;
+static const int allocationHeadroom = 2;
+
+
+MorphBlobDetector::MorphBlobDetector() {
+	drawBlobs = true;
+	blobEngine = BLOBS_CONTOURS;
+	labeler = NULL;
+	segmentation = SEGMENT_CANNY;
+	colorLut = NULL;
+	sobelDetector = NULL;
+	inputGray = NULL;
+	adaptiveMinContours = 0;
+	adaptiveMaxContours = 0;
+	gradientHistogram = NULL;
+	numThreads = 1;
+	tiles = NULL;
+	numTiles = 1;
+	seamContours = NULL;
+	cannyLowThreshold = 100;
+	cannyHighThreshold = 200;
+	numContours = 0;
+	changeTileSize = 0;
+	changeThreshold = 0;
+	changeRefreshInterval = 0;
+	changeDetector = NULL;
+	dirtyRegions = NULL;
+	dirtyTileFraction = 1;
+}
+
+/*
+ * BLOBS_CONTOURS (default): cvFindContours on the canny edges, and the area and length of each contour.
+ * BLOBS_LABELING: connected component labeling of the canny edges (see BlobLabeler),
+ *                 with the area and length estimated from the pixels, and the same roundness filter.
+ * Call it before init.
+ */
+void MorphBlobDetector::setBlobEngine(int blobEngine) {
+	assert(blobEngine == BLOBS_CONTOURS || blobEngine == BLOBS_LABELING);
+	this->blobEngine = blobEngine;
+}
+
+/*
+ * SEGMENT_CANNY (default): the blobs are found in the canny edges of the gray image.
+ * SEGMENT_COLOR_LUT: the blobs are found in the binary mask of the red pixels,
+ *                    classified with colorLut (not owned, see ColorLut). No canny.
+ * SEGMENT_SOBEL: the edges are the pixels with a sobel gradient magnitude >= cannyHighThreshold
+ *                (see SobelEdgeDetector), much cheaper than canny (no hysteresis),
+ *                and the adaptive thresholds work the same way (only the high threshold is used).
+ * SEGMENT_SOBEL_THIN: SEGMENT_SOBEL, thinned with a simplified non-maximum suppression.
+ * The mask replaces the canny edges (cannyImage), so both blob engines
+ * and the roundness filter work the same way on it.
+ * Call it before init.
+ */
+void MorphBlobDetector::setSegmentation(int segmentation, ColorLut *colorLut) {
+	assert(segmentation == SEGMENT_CANNY || segmentation == SEGMENT_SOBEL || segmentation == SEGMENT_SOBEL_THIN
+	       || (segmentation == SEGMENT_COLOR_LUT && colorLut != NULL));
+	this->segmentation = segmentation;
+	this->colorLut = colorLut;
+}
+
+/*
+ * Adaptive canny thresholds (call it before init).
+ * The fixed thresholds (100, 200) give from a few to hundreds of contours, depending on the lighting,
+ * and the cost of the blob detector and the hough transform grows with the number of contours.
+ * After each frame, the target fraction of edge pixels is steered towards minContours..maxContours
+ * (contours per whole frame), and the next thresholds are the percentile of the gradient histogram
+ * of this frame with that fraction (high threshold, and half of it for the low threshold).
+ * The first frame uses the fixed thresholds.
+ * maxContours = 0 disables it.
+ */
+void MorphBlobDetector::setAdaptiveCanny(int minContours, int maxContours) {
+	assert(maxContours == 0 || (minContours >= 1 && minContours <= maxContours));
+	adaptiveMinContours = minContours;
+	adaptiveMaxContours = maxContours;
+}
+
+/*
+ * Number of worker threads (call it before init). default = 1.
+ * With more threads, findBlobs splits the roi into horizontal tiles (one for each thread, at most maxTiles).
+ * Each thread converts to gray and runs canny on its tile (with overlap rows above and below),
+ * and then cvFindContours on the edges of the tile.
+ * The contours touching the seam between two tiles are discarded by the tiles,
+ * and the band of rows around each seam containing them is searched again (one thread),
+ * keeping only the contours crossing the seam (the merged blobs).
+ * The blobs are returned in a fixed order (the tiles from top to bottom, and then the seams),
+ * so the result does not depend on the thread scheduling.
+ * The canny edges near the seams may differ slightly from the whole frame canny
+ * (the hysteresis only sees tileOverlapRows rows of the next tile).
+ */
+void MorphBlobDetector::setNumThreads(int numThreads) {
+	assert(numThreads >= 1);
+	this->numThreads = numThreads;
+}
+
+/*
+ * Change detection (call it before init).
+ * With a slow or hovering MAV, most of the image does not change between frames.
+ * findBlobs(srcImage) marks the tiles (tileSize x tileSize) which changed since they were processed
+ * (see TileChangeDetector), and only the regions around the dirty tiles go through canny and contours
+ * (findBlobs with roi, keeping the blobs outside it). The blobs of the clean tiles are the ones of the previous frames.
+ * The whole frame is processed every refreshInterval frames (0 = never).
+ * tileSize = 0 disables it.
+ */
+void MorphBlobDetector::setChangeDetection(int tileSize, double threshold, int refreshInterval) {
+	assert(tileSize == 0 || tileSize >= 8);
+	changeTileSize = tileSize;
+	changeThreshold = threshold;
+	changeRefreshInterval = refreshInterval;
+}
+
+/*
+ * The gray image of the srcImage of the next findBlobs, computed by the caller
+ * (e.g. with the undistortion, see CameraUndistort::setFusedOutput), same size as srcImage.
+ * The edges are found directly in it, without the conversion (grayImage is not updated).
+ * It can be set once, if the caller updates the same image for each frame. NULL (default) = converted here.
+ */
+void MorphBlobDetector::setGrayImage(IplImage *gray) {
+	assert(gray == NULL || gray->nChannels == 1);
+	inputGray = gray;
+}
+
+/*
+ * If drawBlobs (default), findBlobs draws the blobs into blobsImage (for visualizing).
+ * Otherwise blobsImage is not updated, and only blobCentroid is computed.
+ */
+void MorphBlobDetector::setDrawBlobs(bool drawBlobs) {
+	this->drawBlobs = drawBlobs;
+}
+
 void MorphBlobDetector::init(IplImage *current_frame) {
 	cout << "MorphBlobDetector. init" << endl;
 	width = current_frame->width;
@@ -65,7 +236,55 @@ void MorphBlobDetector::init(IplImage *current_frame) {
 	temp1CImage  = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
 	temp3CImage  = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
 
-	blobCentroid = NULL;
+	//owned by the detector, and reused by findBlobs
+	storage = cvCreateMemStorage(0);
+	blobCentroidCapacity = 256;
+	blobCentroid = new int[blobCentroidCapacity][2];
+	numBlobs = 0;
+	heapAllocations = 0;
+	heapAllocationOverruns = 0;
+	warmupFrames = 0;
+	maxBlobCentroidsNeeded = 0;
+	seamFilter = false;
+
+	if (blobEngine == BLOBS_LABELING)
+		labeler = new BlobLabeler(width, height);
+	if (segmentation == SEGMENT_SOBEL || segmentation == SEGMENT_SOBEL_THIN) {
+		sobelDetector = new SobelEdgeDetector();
+		sobelDetector->setThin(segmentation == SEGMENT_SOBEL_THIN);
+	}
+
+	cannyLowThreshold = 100;
+	cannyHighThreshold = 200;
+	numContours = 0;
+	edgeFraction = -1;   //unknown until the first frame
+	if (adaptiveMaxContours > 0)
+		gradientHistogram = new int[gradientLevels];
+
+	if (numThreads > 1) {
+		//the rows of the largest tile: roi = the whole image, or few tiles of at least minTileRows rows
+		int maxTileRows = Max((height + numThreads - 1) / numThreads, 2 * minTileRows);
+		int bufferRows = Min(maxTileRows + 2 * tileOverlapRows, height);
+		tiles = new BlobTile[numThreads];
+		for (int t = 0; t < numThreads; t++) {
+			tiles[t].grayBuffer = _cvCreateImage(cvSize(width, bufferRows), IPL_DEPTH_8U, 1);
+			tiles[t].buffer = _cvCreateImage(cvSize(width, bufferRows), IPL_DEPTH_8U, 1);
+			tiles[t].storage = cvCreateMemStorage(0);
+			tiles[t].sobel = NULL;
+			if (sobelDetector != NULL) {
+				tiles[t].sobel = new SobelEdgeDetector();
+				tiles[t].sobel->setThin(segmentation == SEGMENT_SOBEL_THIN);
+			}
+		}
+		seamContours = new CvSeq*[numThreads];
+	}
+
+	dirtyTileFraction = 1;
+	if (changeTileSize > 0) {
+		changeDetector = new TileChangeDetector(changeTileSize, changeThreshold, changeRefreshInterval);
+		changeDetector->init(width, height);
+		dirtyRegions = new CvRect[maxDirtyRegions];
+	}
 }
 
 
@@ -78,6 +297,22 @@ MorphBlobDetector::~MorphBlobDetector() {
 	cvReleaseImage(&temp1CImage);
 	cvReleaseImage(&temp3CImage);
 	delete[] blobCentroid;
+	delete labeler;
+	delete sobelDetector;
+	delete[] gradientHistogram;
+	cvReleaseMemStorage(&storage);
+	if (tiles != NULL) {
+		for (int t = 0; t < numThreads; t++) {
+			cvReleaseImage(&tiles[t].grayBuffer);
+			cvReleaseImage(&tiles[t].buffer);
+			cvReleaseMemStorage(&tiles[t].storage);
+			delete tiles[t].sobel;
+		}
+		delete[] tiles;
+		delete[] seamContours;
+	}
+	delete changeDetector;
+	delete[] dirtyRegions;
 }
 
 //cvZero(cannyImage);
@@ -85,27 +320,207 @@ MorphBlobDetector::~MorphBlobDetector() {
 //cvCircle(cannyImage, cvPoint(150,200), 20, cvRealScalar(255));
 void MorphBlobDetector::findBlobs(IplImage *srcImage)
 {
-	CvMemStorage *storage = cvCreateMemStorage(0);
+	int heapAllocationsBefore = heapAllocations;
+	if (changeDetector == NULL) {
+		findBlobsInRoi(srcImage, cvRect(0, 0, width, height), false);
+	} else {
+		//only the regions which changed (see setChangeDetection)
+		int numDirtyTiles = changeDetector->update(srcImage);
+		dirtyTileFraction = changeDetector->dirtyFraction;
+		if (numDirtyTiles == changeDetector->numTiles) {
+			findBlobsInRoi(srcImage, cvRect(0, 0, width, height), false);
+		} else {
+			int numRegions = changeDetector->getDirtyRegions(dirtyMarginTiles, dirtyRegions, maxDirtyRegions);
+			for (int r = 0; r < numRegions; r++)
+				findBlobsInRoi(srcImage, dirtyRegions[r], true);
+		}
+	}
+	endFrame(heapAllocationsBefore);
+}
+
+/*
+ * Finds the blobs only inside the region roi of the image.
+ * If keepBlobsOutsideRoi, the blobs found in previous calls outside roi are kept
+ * (e.g. processing alternatively the top and the bottom half of the image),
+ * otherwise, only the blobs inside roi are returned.
+ * One call is one frame (see endFrame).
+ */
+void MorphBlobDetector::findBlobs(IplImage *srcImage, CvRect roi, bool keepBlobsOutsideRoi)
+{
+	int heapAllocationsBefore = heapAllocations;
+	findBlobsInRoi(srcImage, roi, keepBlobsOutsideRoi);
+	endFrame(heapAllocationsBefore);
+}
+
+/*
+ * Finds the blobs of ownedRect, processing roi (ownedRect with a margin, e.g. an image half and some rows of the other half).
+ * The blobs found in previous calls outside ownedRect are kept.
+ * A blob found in roi is kept only if its centroid is inside ownedRect
+ * and it does not touch an edge of roi inside the image (a seam, where the blob is clipped).
+ * So with a margin larger than the blobs, a blob crossing between two owned rects (e.g. the image halves)
+ * is found once and whole, by the call owning its centroid. Larger blobs crossing the seam are missed.
+ * One call is one frame (see endFrame).
+ */
+void MorphBlobDetector::findBlobs(IplImage *srcImage, CvRect roi, CvRect ownedRect)
+{
+	assert(ownedRect.x >= roi.x && ownedRect.y >= roi.y);
+	assert(ownedRect.x + ownedRect.width <= roi.x + roi.width && ownedRect.y + ownedRect.height <= roi.y + roi.height);
+	int heapAllocationsBefore = heapAllocations;
+	seamFilter = true;
+	this->ownedRect = ownedRect;
+	findBlobsInRoi(srcImage, roi, true);
+	seamFilter = false;
+	endFrame(heapAllocationsBefore);
+}
+
+//findBlobs of roi, one of the calls of a frame
+void MorphBlobDetector::findBlobsInRoi(IplImage *srcImage, CvRect roi, bool keepBlobsOutsideRoi)
+{
+	int storageBlocksBefore = countStorageBlocks();
+	int labelerAllocationsBefore = (labeler != NULL) ? labeler->heapAllocations : 0;
+	cvClearMemStorage(storage);   //the blocks are kept, for the next cvFindContours
 	CvSeq *contour = NULL;
+	IplImage *gray = (inputGray != NULL) ? inputGray : grayImage;
+	blobRoi = roi;
+	if (!seamFilter)
+		ownedRect = roi;
 
-	cvCvtColor (srcImage, grayImage, CV_BGR2GRAY);
-	
-	//edge detector
-	//IMPORTANT!!!! TODO: try different thresholds or choose the thresholds automatically!!!
-	cvCanny(grayImage, cannyImage, 100, 200); 
-	cvCopy(cannyImage, temp1CImage);
+	int contoursFound = 0;
+	numTiles = (numThreads > 1) ? Min(Min(numThreads, maxTiles), roi.height / minTileRows) : 1;
+	if (numTiles > 1) {
+		//in parallel, by tiles (see setNumThreads)
+		contoursFound = findContoursByTiles(srcImage, roi, numTiles);
+	} else {
+		numTiles = 1;
+		cvSetImageROI(srcImage, roi);
+		cvSetImageROI(gray, roi);
+		cvSetImageROI(cannyImage, roi);
+		cvSetImageROI(temp1CImage, roi);
 
-	//get all the blob countours
-	int contoursFound = cvFindContours(temp1CImage, storage, &contour, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(0,0));
+		if (segmentation != SEGMENT_COLOR_LUT) {
+			if (inputGray == NULL)
+				cvCvtColor (srcImage, grayImage, CV_BGR2GRAY);
+			
+			//edge detector. fixed thresholds, or chosen by the previous frame (see setAdaptiveCanny)
+			if (segmentation == SEGMENT_CANNY)
+				cvCanny(gray, cannyImage, cannyLowThreshold, cannyHighThreshold); 
+			else
+				sobelDetector->detect(gray, cannyImage, roi, (int)cannyHighThreshold);
+		} else {
+			//red pixels mask
+			colorLut->segment(srcImage, cannyImage, roi);
+		}
 
-	//prepare vector blobcentroids, maximum size
-	if (blobCentroid) delete[] blobCentroid;
-	blobCentroid = new int[contoursFound][2];
-	numBlobs = 0;
+		if (blobEngine == BLOBS_CONTOURS) {
+			//get all the blob countours (relative to roi)
+			cvCopy(cannyImage, temp1CImage);
+			contoursFound = cvFindContours(temp1CImage, storage, &contour, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(0,0));
+		}
+
+		cvResetImageROI(srcImage);
+		cvResetImageROI(gray);
+		cvResetImageROI(cannyImage);
+		cvResetImageROI(temp1CImage);
+	}
+
+	if (blobEngine == BLOBS_LABELING) {
+		//get all the blobs, by connected component labeling (image coordinates)
+		contoursFound = labeler->label(cannyImage, roi);
+	}
+	numContours = contoursFound;
+	if (segmentation != SEGMENT_COLOR_LUT && adaptiveMaxContours > 0)
+		updateCannyThresholds(gray, roi);
+
+	//blob centroids, maximum size. the blobs kept from previous calls are moved to the beginning
+	int numKeptBlobs = 0;
+	if (keepBlobsOutsideRoi) {
+		for (int i = 0; i < numBlobs; i++) {
+			int x = blobCentroid[i][0];
+			int y = blobCentroid[i][1];
+			if (x < ownedRect.x || x >= ownedRect.x + ownedRect.width || y < ownedRect.y || y >= ownedRect.y + ownedRect.height) {
+				blobCentroid[numKeptBlobs][0] = x;
+				blobCentroid[numKeptBlobs][1] = y;
+				numKeptBlobs++;
+			}
+		}
+	}
+	maxBlobCentroidsNeeded = Max(maxBlobCentroidsNeeded, numKeptBlobs + contoursFound);
+	reserveBlobCentroids(numKeptBlobs + contoursFound, numKeptBlobs);
+	numBlobs = numKeptBlobs;
 	
-	cvZero(blobsImage);
-	//const double roundnessThreshold = 0.1;
-	const double roundnessThreshold = 0.05;
+	if (drawBlobs) {
+		if (keepBlobsOutsideRoi) {
+			cvSetImageROI(blobsImage, roi);
+			cvZero(blobsImage);
+			cvResetImageROI(blobsImage);
+		} else {
+			cvZero(blobsImage);
+		}
+	}
+
+	if (blobEngine == BLOBS_LABELING)
+		findLabeledBlobs();
+	else if (numTiles > 1)
+		findTiledContourBlobs(roi);
+	else
+		findContourBlobs(contour, roi);
+
+	//debug. buffers grown (see endFrame)
+	heapAllocations += countStorageBlocks() - storageBlocksBefore;
+	if (labeler != NULL)
+		heapAllocations += labeler->heapAllocations - labelerAllocationsBefore;
+}
+
+/*
+ * HEAP ALLOCATIONS
+ * findBlobs reuses its buffers (the blob centroids, the contours storage and the labeler statistics), which only grow.
+ * During the first allocationWarmupFrames frames they grow to the needs of the video,
+ * and then the blob centroids and the labeler statistics are reserved for allocationHeadroom times
+ * the most needed in a frame so far,
+ * so that the next frames do not allocate memory even with somewhat more contours.
+ * A frame which still grows a buffer after the warm-up is valid (e.g. a much more textured scene),
+ * but it is reported (heapAllocationOverruns, and a message).
+ * Not counted: the temporary buffers allocated inside cvCanny and cvFindContours.
+ */
+void MorphBlobDetector::endFrame(int heapAllocationsBefore)
+{
+	if (warmupFrames < allocationWarmupFrames) {
+		warmupFrames++;
+		if (warmupFrames == allocationWarmupFrames) {
+			reserveBlobCentroids(allocationHeadroom * maxBlobCentroidsNeeded, numBlobs);
+			if (labeler != NULL)
+				labeler->reserve(allocationHeadroom * labeler->maxLabelsUsed, allocationHeadroom * labeler->maxComponentsUsed);
+		}
+		return;
+	}
+	if (heapAllocations != heapAllocationsBefore) {
+		heapAllocationOverruns++;
+		cout << "MorphBlobDetector. buffers grown after the warm-up, " << maxBlobCentroidsNeeded << " blob centroids" << endl;
+	}
+}
+
+/*
+ * Whether a blob found in blobRoi is kept, see findBlobs with ownedRect (always, otherwise).
+ * (x, y) is its centroid, and [boxX0, boxX1] x [boxY0, boxY1] its bounding box (image coordinates).
+ * cvFindContours clears the border of the roi, so a blob clipped by a seam has its box one pixel inside:
+ * the boxes up to one pixel from a seam touch it.
+ */
+bool MorphBlobDetector::acceptBlob(int x, int y, int boxX0, int boxY0, int boxX1, int boxY1)
+{
+	if (!seamFilter)
+		return true;
+	if (x < ownedRect.x || x >= ownedRect.x + ownedRect.width || y < ownedRect.y || y >= ownedRect.y + ownedRect.height)
+		return false;   //found by the call owning its centroid
+	int roiX1 = blobRoi.x + blobRoi.width - 1;
+	int roiY1 = blobRoi.y + blobRoi.height - 1;
+	bool touchesSeam = (blobRoi.x > 0 && boxX0 <= blobRoi.x + 1) || (roiX1 < width - 1 && boxX1 >= roiX1 - 1) ||
+	                   (blobRoi.y > 0 && boxY0 <= blobRoi.y + 1) || (roiY1 < height - 1 && boxY1 >= roiY1 - 1);
+	return !touchesSeam;
+}
+
+//the round contours
+void MorphBlobDetector::findContourBlobs(CvSeq *contour, CvRect roi)
+{
 	while(contour) {
 		double area = -cvContourArea(contour, CV_WHOLE_SEQ);
 		bool keep = (area != 0);
@@ -119,27 +534,364 @@ void MorphBlobDetector::findBlobs(IplImage *srcImage)
 		}
 
 		if (keep) {
-			//find the centroids. TODO: faster implementation!
+			//find the centroids.
+			//the filled contour is inside its bounding box, so only the bounding box is drawn and scanned
+			//(the same pixels as filling the whole image)
 			int x, y;
+			CvRect box = cvBoundingRect(contour, 0);
+			box.x += roi.x;
+			box.y += roi.y;
+			cvSetImageROI(temp1CImage, box);
 			cvZero(temp1CImage);
-			cvDrawContours(temp1CImage, contour, CV_WHITE, CV_WHITE, -1, CV_FILLED, 8);
-			computeCentroid(temp1CImage, &x, &y);
+			cvDrawContours(temp1CImage, contour, CV_WHITE, CV_WHITE, -1, CV_FILLED, 8, cvPoint(roi.x - box.x, roi.y - box.y));
+			cvResetImageROI(temp1CImage);
+			computeCentroid(temp1CImage, box, &x, &y);
 			//cout << "x=" << x << ", y=" << y << endl;
 			if (x == -1) {
 				cout << "There is something wrong. area = " << area << ", however cvDrawCountours drawed nothing." << endl;
-			} else {
+			} else if (acceptBlob(x, y, box.x, box.y, box.x + box.width - 1, box.y + box.height - 1)) {
 				blobCentroid[numBlobs][0] = x;
 				blobCentroid[numBlobs][1] = y;
 				numBlobs++;
 			
 				//just for visualizing
-				cvCopy(temp1CImage, blobsImage, temp1CImage);   //add this blob to the blobsImage
+				if (drawBlobs) {
+					cvSetImageROI(temp1CImage, box);
+					cvSetImageROI(blobsImage, box);
+					cvCopy(temp1CImage, blobsImage, temp1CImage);   //add this blob to the blobsImage
+					cvResetImageROI(temp1CImage);
+					cvResetImageROI(blobsImage);
+				}
 				//cvDrawContours(blobsImage, contour, CV_WHITE, CV_WHITE, -1, CV_FILLED, 8);
 			}
 		}
 		contour = contour->h_next;
 	}
-	cvReleaseMemStorage(&storage); // desallocate CvSeq as well.
+}
+
+
+//header over the rectangle rect of image, sharing its data.
+//it has no roi, so each thread can use its own header over the same image
+static void initImageView(IplImage *view, IplImage *image, CvRect rect)
+{
+	assert(image->depth == IPL_DEPTH_8U);
+	cvInitImageHeader(view, cvSize(rect.width, rect.height), image->depth, image->nChannels);
+	view->widthStep = image->widthStep;
+	view->imageSize = image->widthStep * rect.height;
+	view->imageData = image->imageData + rect.y * image->widthStep + rect.x * image->nChannels;
+	view->imageDataOrigin = view->imageData;
+}
+
+//copies the rows [y0, y1) of the columns of roi from src (row 0 = image row srcY) to dst (row 0 = image row dstY)
+static void copyRows(IplImage *src, int srcY, IplImage *dst, int dstY, CvRect roi, int y0, int y1)
+{
+	for (int y = y0; y < y1; y++)
+		memcpy(dst->imageData + (y - dstY) * dst->widthStep + roi.x * dst->nChannels,
+		       src->imageData + (y - srcY) * src->widthStep + roi.x * src->nChannels, roi.width * src->nChannels);
+}
+
+/*
+ * The front end of findBlobs (gray, canny, contours) in parallel by tiles, see setNumThreads.
+ * Returns the number of contours, in the lists of the tiles and of the seam regions (relative to roi).
+ */
+int MorphBlobDetector::findContoursByTiles(IplImage *srcImage, CvRect roi, int numTiles)
+{
+	for (int t = 0; t < numTiles; t++) {
+		tiles[t].yStart = roi.y + roi.height * t / numTiles;
+		tiles[t].yEnd = roi.y + roi.height * (t + 1) / numTiles;
+	}
+	tileSrcImage = srcImage;
+	tileRoi = roi;
+	parallelFor(numTiles, processTile, this, numThreads);
+
+	int contoursFound = 0;
+	for (int t = 0; t < numTiles; t++)
+		contoursFound += tiles[t].numContours;
+	numSeamRegions = 0;
+	if (blobEngine != BLOBS_CONTOURS)
+		return contoursFound;
+
+	//the seam regions: the rows of the contours touching each seam, from both sides.
+	//the regions that overlap (e.g. a contour touching two seams) are merged
+	int regionStart[maxTiles], regionEnd[maxTiles];   //at most numTiles - 1
+	assert(numTiles <= maxTiles);
+	for (int t = 0; t + 1 < numTiles; t++) {
+		int start = tiles[t].seamBottomStart;
+		int end = tiles[t + 1].seamTopEnd;
+		if (start == end)
+			continue;   //nothing touches this seam
+		if (numSeamRegions > 0 && regionEnd[numSeamRegions - 1] + 1 >= start) {
+			regionEnd[numSeamRegions - 1] = end;
+		} else {
+			regionStart[numSeamRegions] = start;
+			regionEnd[numSeamRegions] = end;
+			numSeamRegions++;
+		}
+	}
+
+	//the contours of each region (with one row of margin, as cvFindContours clears the border)
+	//which touch a seam
+	for (int r = 0; r < numSeamRegions; r++) {
+		int y0 = Max(roi.y, regionStart[r] - 1);
+		int y1 = Min(roi.y + roi.height, regionEnd[r] + 1);
+		CvRect rect = cvRect(roi.x, y0, roi.width, y1 - y0);
+		cvSetImageROI(cannyImage, rect);
+		cvSetImageROI(temp1CImage, rect);
+		cvCopy(cannyImage, temp1CImage);
+		CvSeq *contour = NULL;
+		cvFindContours(temp1CImage, storage, &contour, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(0, y0 - roi.y));
+		cvResetImageROI(cannyImage);
+		cvResetImageROI(temp1CImage);
+
+		CvSeq *first = NULL, *last = NULL;
+		for (CvSeq *c = contour; c != NULL; c = c->h_next) {
+			CvRect box = ((CvContour*)c)->rect;
+			bool crossesSeam = false;
+			for (int t = 0; t + 1 < numTiles; t++) {
+				int seam = tiles[t].yEnd - roi.y;   //rows seam - 1 and seam
+				if (box.y <= seam && box.y + box.height >= seam)
+					crossesSeam = true;
+			}
+			if (!crossesSeam)
+				continue;
+			c->h_prev = last;
+			if (last != NULL)
+				last->h_next = c;
+			else
+				first = c;
+			last = c;
+			contoursFound++;
+		}
+		if (last != NULL)
+			last->h_next = NULL;
+		seamContours[r] = first;
+	}
+	return contoursFound;
+}
+
+/*
+ * Worker of findContoursByTiles: gray, canny (or the color mask) and contours of the tile tileIdx.
+ * It only writes its own rows of grayImage and cannyImage, and its own buffers.
+ */
+void MorphBlobDetector::processTile(void *arg, int tileIdx)
+{
+	MorphBlobDetector *detector = (MorphBlobDetector*) arg;
+	BlobTile &tile = detector->tiles[tileIdx];
+	CvRect roi = detector->tileRoi;
+	bool firstTile = (tile.yStart == roi.y);
+	bool lastTile = (tile.yEnd == roi.y + roi.height);
+
+	//the tile rows, and the overlap rows for canny
+	tile.bufferY = Max(roi.y, tile.yStart - tileOverlapRows);
+	int bufferRows = Min(roi.y + roi.height, tile.yEnd + tileOverlapRows) - tile.bufferY;
+	assert(bufferRows <= tile.buffer->height);
+	IplImage bufferView;
+	initImageView(&bufferView, tile.buffer, cvRect(roi.x, 0, roi.width, bufferRows));
+
+	if (detector->segmentation != SEGMENT_COLOR_LUT) {
+		IplImage srcView, grayView;
+		if (detector->inputGray != NULL) {
+			//the gray image of the caller, read in place
+			initImageView(&grayView, detector->inputGray, cvRect(roi.x, tile.bufferY, roi.width, bufferRows));
+		} else {
+			initImageView(&srcView, detector->tileSrcImage, cvRect(roi.x, tile.bufferY, roi.width, bufferRows));
+			initImageView(&grayView, tile.grayBuffer, cvRect(roi.x, 0, roi.width, bufferRows));
+			cvCvtColor(&srcView, &grayView, CV_BGR2GRAY);
+		}
+		if (detector->segmentation == SEGMENT_CANNY)
+			cvCanny(&grayView, &bufferView, detector->cannyLowThreshold, detector->cannyHighThreshold);
+		else
+			tile.sobel->detect(&grayView, &bufferView, cvRect(0, 0, roi.width, bufferRows), (int)detector->cannyHighThreshold);
+		if (detector->inputGray == NULL)
+			copyRows(tile.grayBuffer, tile.bufferY, detector->grayImage, 0, roi, tile.yStart, tile.yEnd);
+		copyRows(tile.buffer, tile.bufferY, detector->cannyImage, 0, roi, tile.yStart, tile.yEnd);
+	} else {
+		CvRect tileRect = cvRect(roi.x, tile.yStart, roi.width, tile.yEnd - tile.yStart);
+		detector->colorLut->segment(detector->tileSrcImage, detector->cannyImage, tileRect);
+		copyRows(detector->cannyImage, 0, tile.buffer, tile.bufferY, roi, tile.yStart, tile.yEnd);
+	}
+
+	tile.contour = NULL;
+	tile.numContours = 0;
+	tile.seamTopEnd = tile.yStart;
+	tile.seamBottomStart = tile.yEnd;
+	if (detector->blobEngine != BLOBS_CONTOURS)
+		return;
+
+	//contours of the tile rows, with one row of margin at the seams (cvFindContours clears the border)
+	int viewY0 = firstTile ? tile.yStart : tile.yStart - 1;
+	int viewY1 = lastTile ? tile.yEnd : tile.yEnd + 1;
+	IplImage contoursView;
+	initImageView(&contoursView, tile.buffer, cvRect(roi.x, viewY0 - tile.bufferY, roi.width, viewY1 - viewY0));
+	cvClearMemStorage(tile.storage);
+	CvSeq *contour = NULL;
+	cvFindContours(&contoursView, tile.storage, &contour, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(0, viewY0 - roi.y));
+
+	//the contours touching a seam are left for findContoursByTiles
+	CvSeq *first = NULL, *last = NULL;
+	for (CvSeq *c = contour; c != NULL; c = c->h_next) {
+		CvRect box = ((CvContour*)c)->rect;
+		int boxY0 = roi.y + box.y;
+		int boxY1 = roi.y + box.y + box.height;
+		bool touchesTop = !firstTile && boxY0 <= tile.yStart;
+		bool touchesBottom = !lastTile && boxY1 >= tile.yEnd;
+		if (touchesTop)
+			tile.seamTopEnd = Max(tile.seamTopEnd, boxY1);
+		if (touchesBottom)
+			tile.seamBottomStart = Min(tile.seamBottomStart, boxY0);
+		if (touchesTop || touchesBottom)
+			continue;
+		c->h_prev = last;
+		if (last != NULL)
+			last->h_next = c;
+		else
+			first = c;
+		last = c;
+		tile.numContours++;
+	}
+	if (last != NULL)
+		last->h_next = NULL;
+	tile.contour = first;
+}
+
+//the round contours of the tiles and of the seam regions, in a fixed order
+void MorphBlobDetector::findTiledContourBlobs(CvRect roi)
+{
+	for (int t = 0; t < numTiles; t++)
+		findContourBlobs(tiles[t].contour, roi);
+	for (int r = 0; r < numSeamRegions; r++)
+		findContourBlobs(seamContours[r], roi);
+}
+
+
+/*
+ * The blob centroids array grows geometrically (at least twice the capacity),
+ * keeping the first numToKeep centroids.
+ */
+void MorphBlobDetector::reserveBlobCentroids(int capacity, int numToKeep)
+{
+	if (capacity <= blobCentroidCapacity)
+		return;
+	blobCentroidCapacity = Max(capacity, 2 * blobCentroidCapacity);
+	int (*newBlobCentroid)[2] = new int[blobCentroidCapacity][2];
+	memcpy(newBlobCentroid, blobCentroid, numToKeep * sizeof(blobCentroid[0]));
+	delete[] blobCentroid;
+	blobCentroid = newBlobCentroid;
+	heapAllocations++;
+}
+
+/*
+ * The canny thresholds for the next frame (see setAdaptiveCanny).
+ * The contours found in roi are scaled to the whole frame.
+ */
+void MorphBlobDetector::updateCannyThresholds(IplImage *gray, CvRect roi)
+{
+	//gradient histogram of the gray image inside roi, every other row and column
+	memset(gradientHistogram, 0, gradientLevels * sizeof(int));
+	int step = gray->widthStep;
+	int numSamples = 0;
+	for (int y = roi.y + 1; y < roi.y + roi.height - 1; y += 2) {
+		uchar *p = (uchar*) gray->imageData + y*step;
+		for (int x = roi.x + 1; x < roi.x + roi.width - 1; x += 2) {
+			int dx = (p[x+1-step] + 2*p[x+1] + p[x+1+step]) - (p[x-1-step] + 2*p[x-1] + p[x-1+step]);
+			int dy = (p[x-1+step] + 2*p[x+step] + p[x+1+step]) - (p[x-1-step] + 2*p[x-step] + p[x+1-step]);
+			gradientHistogram[abs(dx) + abs(dy)]++;
+			numSamples++;
+		}
+	}
+	if (numSamples == 0)
+		return;
+
+	//the first frame: the fraction of edge pixels of the fixed thresholds
+	if (edgeFraction < 0) {
+		int above = 0;
+		for (int g = (int)cannyHighThreshold; g < gradientLevels; g++)
+			above += gradientHistogram[g];
+		edgeFraction = (double)above / numSamples;
+	}
+
+	//controller. the number of contours grows roughly with the number of edge pixels
+	double frameContours = (double)numContours * width * height / (roi.width * roi.height);
+	double targetContours = (adaptiveMinContours + adaptiveMaxContours) / 2.;
+	if (frameContours < adaptiveMinContours || frameContours > adaptiveMaxContours) {
+		double ratio = targetContours / max(frameContours, 1.);
+		edgeFraction *= min(max(ratio, 0.5), 2.);
+	}
+	edgeFraction = min(max(edgeFraction, minEdgeFraction), maxEdgeFraction);
+
+	//high threshold: the gradient with edgeFraction of the pixels above it
+	int wanted = (int)(edgeFraction * numSamples);
+	int above = 0;
+	int g = gradientLevels - 1;
+	while (g > 1 && above + gradientHistogram[g] <= wanted) {
+		above += gradientHistogram[g];
+		g--;
+	}
+	cannyHighThreshold = g;
+	cannyLowThreshold = g / 2;
+}
+
+//the canny thresholds and contours of the last frame, if they are adaptive, and the dirty tiles, if change detection
+void MorphBlobDetector::drawInfo(IplImage *image)
+{
+	char str[100];
+	if (adaptiveMaxContours > 0 && segmentation == SEGMENT_CANNY) {
+		sprintf(str, "canny %d/%d  contours %d", (int)cannyLowThreshold, (int)cannyHighThreshold, numContours);
+		cvPutText(image, str, cvPoint(15, 30), &font, CV_RED);
+	} else if (adaptiveMaxContours > 0 && segmentation != SEGMENT_COLOR_LUT) {
+		sprintf(str, "sobel %d  contours %d", (int)cannyHighThreshold, numContours);
+		cvPutText(image, str, cvPoint(15, 30), &font, CV_RED);
+	}
+	if (changeDetector != NULL) {
+		sprintf(str, "dirty tiles %d%%", (int)(dirtyTileFraction * 100 + 0.5));
+		cvPutText(image, str, cvPoint(15, 60), &font, CV_RED);
+	}
+}
+
+//number of memory blocks allocated by storage
+int MorphBlobDetector::countStorageBlocks()
+{
+	int numBlocks = 0;
+	for (CvMemBlock *block = storage->bottom; block != NULL; block = block->next)
+		numBlocks++;
+	for (int t = 0; tiles != NULL && t < numThreads; t++)
+		for (CvMemBlock *block = tiles[t].storage->bottom; block != NULL; block = block->next)
+			numBlocks++;
+	return numBlocks;
+}
+
+
+//the blobs of the last labeling, with the same roundness filter as the contours
+void MorphBlobDetector::findLabeledBlobs()
+{
+	for (int c = 0; c < labeler->numComponents; c++) {
+		BlobComponent &blob = labeler->components[c];
+		double area = blob.pixels - blob.boundaryPixels;
+		bool keep = (area != 0);
+
+		if (keep) {
+			// remove the blobs that are not "round", according to the roundness metric.
+			double length = blob.boundaryPixels;
+			double roundnessMetric = 4 * CV_PI * area / (length*length);
+			keep = roundnessMetric > roundnessThreshold;
+		}
+
+		if (keep) {
+			int x = (int)(blob.sumX / blob.pixels);
+			int y = (int)(blob.sumY / blob.pixels);
+			keep = acceptBlob(x, y, blob.minX, blob.minY, blob.maxX, blob.maxY);
+			if (keep) {
+				blobCentroid[numBlobs][0] = x;
+				blobCentroid[numBlobs][1] = y;
+				numBlobs++;
+			}
+		}
+		blob.keep = keep;
+	}
+
+	//just for visualizing
+	if (drawBlobs)
+		labeler->drawComponents(blobsImage);
 }
 
 
@@ -159,6 +911,7 @@ IplImage * MorphBlobDetector::processImage(IplImage *srcImage)
 
 	//mixed image + canny
 	cvCvtColor (cannyImage, temp3CImage, CV_GRAY2BGR);
+	drawInfo(temp3CImage);
 	Combine2x1Frames::combine2x1(multipleImage, mixedImage, temp3CImage);
 
 	//return edgesImage;
@@ -41,11 +41,31 @@
 #include "util.h"
 #include "VideoCapture.h"
 
+class BlobLabeler;
+class ColorLut;
+class TileChangeDetector;
+class SobelEdgeDetector;
+struct BlobTile;
+
+enum { BLOBS_CONTOURS, BLOBS_LABELING };
+enum { SEGMENT_CANNY, SEGMENT_COLOR_LUT, SEGMENT_SOBEL, SEGMENT_SOBEL_THIN };
+
 class MorphBlobDetector : public ImageProcessor {
 public:
+	MorphBlobDetector();
+	void setDrawBlobs(bool drawBlobs);
+	void setBlobEngine(int blobEngine);
+	void setSegmentation(int segmentation, ColorLut *colorLut);
+	void setAdaptiveCanny(int minContours, int maxContours);
+	void setNumThreads(int numThreads);
+	void setChangeDetection(int tileSize, double threshold, int refreshInterval);
+	void setGrayImage(IplImage *gray);
 	void init(IplImage *current_frame);
 	void findBlobs(IplImage *srcImage);
+	void findBlobs(IplImage *srcImage, CvRect roi, bool keepBlobsOutsideRoi);
+	void findBlobs(IplImage *srcImage, CvRect roi, CvRect ownedRect);
 	IplImage * processImage(IplImage *srcImage);
+	void drawInfo(IplImage *image);
 	~MorphBlobDetector();
 
 	int width, height;
@@ -55,6 +75,68 @@ public:
 
 	int numBlobs;
 	int (*blobCentroid)[2];
+
+	int heapAllocations;          //debug. buffers grown by findBlobs, so far
+	int heapAllocationOverruns;   //debug. frames which grew a buffer after the warm-up (see endFrame)
+
+	//canny thresholds used in the last findBlobs, and contours found with them (before the roundness filter)
+	double cannyLowThreshold, cannyHighThreshold;
+	int numContours;
+
+	//fraction of the tiles reprocessed by the last findBlobs(srcImage) (see setChangeDetection)
+	double dirtyTileFraction;
+
+private:
+	void findBlobsInRoi(IplImage *srcImage, CvRect roi, bool keepBlobsOutsideRoi);
+	bool acceptBlob(int x, int y, int boxX0, int boxY0, int boxX1, int boxY1);
+	void endFrame(int heapAllocationsBefore);
+	void findContourBlobs(CvSeq *contour, CvRect roi);
+	void findLabeledBlobs();
+	void reserveBlobCentroids(int capacity, int numToKeep);
+	int countStorageBlocks();
+	void updateCannyThresholds(IplImage *gray, CvRect roi);
+	int findContoursByTiles(IplImage *srcImage, CvRect roi, int numTiles);
+	static void processTile(void *arg, int tileIdx);
+	void findTiledContourBlobs(CvRect roi);
+
+	CvMemStorage *storage;
+	int blobCentroidCapacity;
+	int warmupFrames;              //frames so far, up to allocationWarmupFrames
+	int maxBlobCentroidsNeeded;    //high-water mark of the blob centroids in a frame
+
+	//the blobs of the current call (see findBlobs with ownedRect)
+	bool seamFilter;               //false = all the blobs found in blobRoi are accepted
+	CvRect blobRoi;
+	CvRect ownedRect;
+
+	bool drawBlobs;
+	int blobEngine;
+	BlobLabeler *labeler;
+	int segmentation;
+	ColorLut *colorLut;   //not owned
+	SobelEdgeDetector *sobelDetector;   //SEGMENT_SOBEL*, not tiled
+	IplImage *inputGray;    //not owned. NULL = grayImage, converted from srcImage (see setGrayImage)
+
+	//adaptive canny thresholds (see setAdaptiveCanny)
+	int adaptiveMinContours, adaptiveMaxContours;   //0 = disabled
+	double edgeFraction;   //target fraction of pixels with gradient >= cannyHighThreshold
+	int *gradientHistogram;
+
+	//tile parallel front end (see setNumThreads)
+	int numThreads;
+	BlobTile *tiles;        //numThreads
+	int numTiles;           //used by the last findBlobs. 1 = not tiled
+	IplImage *tileSrcImage; //arguments of processTile
+	CvRect tileRoi;
+	int numSeamRegions;
+	CvSeq **seamContours;   //the contours crossing the seams, one list for each seam region
+
+	//change detection (see setChangeDetection)
+	int changeTileSize;     //0 = disabled
+	double changeThreshold;
+	int changeRefreshInterval;
+	TileChangeDetector *changeDetector;
+	CvRect *dirtyRegions;
 };
 
 #endif
@@ -0,0 +1,227 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * PARALLEL FOR
+ * parallelFor(numTasks, task, arg, numThreads) runs task(arg, taskIdx) for taskIdx = 0..numTasks-1,
+ * on numThreads threads (the calling thread is one of them), and returns when all the tasks are done.
+ * Thread t runs the tasks t, t + numThreads, t + 2*numThreads...
+ * The tasks must not write to the same data (each task has its own accumulators, and the caller reduces them).
+ *
+ * numThreads = 1 runs all the tasks in the calling thread, without using any worker thread.
+ * The other threads are a pool of persistent workers (at most maxWorkers), created the first time they are needed,
+ * which wait for their next job between the calls. So a call does not create threads nor allocate memory.
+ * If a worker cannot be created, its tasks run in the calling thread (same result, slower).
+ * The workers are never stopped, they are blocked waiting when the program exits.
+ *
+ * parallelFor must be called from one thread at a time, and not from inside a task.
+ */
+
+#include <cassert>
+
+#ifdef WIN32                    //MsWindows
+  #include <windows.h>
+#else                           //MacOSX
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+#include "Parallel.h"
+
+
+struct ParallelThread {
+	ParallelTask task;
+	void *arg;
+	int numTasks;
+	int firstTaskIdx;
+	int step;
+};
+
+static void runParallelThread(ParallelThread *thread) {
+	for (int taskIdx = thread->firstTaskIdx; taskIdx < thread->numTasks; taskIdx += thread->step)
+		thread->task(thread->arg, taskIdx);
+}
+
+
+//worker w runs the thread w+1 of parallelFor. 63 workers, so that WaitForMultipleObjects gets at most 64 handles
+static const int maxWorkers = 63;
+
+struct PoolWorker {
+	ParallelThread job;
+#ifdef WIN32
+	HANDLE handle;
+	HANDLE wakeEvent;           //auto-reset, set by parallelFor when job is ready
+	HANDLE doneEvent;           //auto-reset, set by the worker when job is done
+#else
+	pthread_t handle;
+	bool hasJob;                //set by parallelFor, cleared by the worker when job is done (under poolMutex)
+#endif
+};
+
+static PoolWorker workers[maxWorkers];
+static int numWorkers = 0;              //workers[0..numWorkers-1] are running
+static bool workerCreationFailed = false;   //do not retry on every call
+
+#ifdef WIN32
+static HANDLE doneEvents[maxWorkers];   //doneEvent of the workers with a job in this call
+
+static DWORD WINAPI poolWorkerMain(LPVOID param) {
+	PoolWorker *worker = (PoolWorker *)param;
+	for (;;) {
+		WaitForSingleObject(worker->wakeEvent, INFINITE);
+		runParallelThread(&worker->job);
+		SetEvent(worker->doneEvent);
+	}
+	return 0;
+}
+
+static bool createWorker(PoolWorker *worker) {
+	worker->wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	worker->doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (worker->wakeEvent != NULL && worker->doneEvent != NULL) {
+		worker->handle = CreateThread(NULL, 0, poolWorkerMain, worker, 0, NULL);
+		if (worker->handle != NULL)
+			return true;
+	}
+	if (worker->wakeEvent != NULL)
+		CloseHandle(worker->wakeEvent);
+	if (worker->doneEvent != NULL)
+		CloseHandle(worker->doneEvent);
+	return false;
+}
+#else
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t workDone = PTHREAD_COND_INITIALIZER;
+static int pendingWorkers = 0;          //workers with a job not yet done (under poolMutex)
+
+static void * poolWorkerMain(void *param) {
+	PoolWorker *worker = (PoolWorker *)param;
+	pthread_mutex_lock(&poolMutex);
+	for (;;) {
+		while (!worker->hasJob)
+			pthread_cond_wait(&workAvailable, &poolMutex);
+		pthread_mutex_unlock(&poolMutex);
+		runParallelThread(&worker->job);
+		pthread_mutex_lock(&poolMutex);
+		worker->hasJob = false;
+		if (--pendingWorkers == 0)
+			pthread_cond_signal(&workDone);
+	}
+	return NULL;
+}
+
+static bool createWorker(PoolWorker *worker) {
+	worker->hasJob = false;
+	return pthread_create(&worker->handle, NULL, poolWorkerMain, worker) == 0;
+}
+#endif
+
+
+void parallelFor(int numTasks, ParallelTask task, void *arg, int numThreads) {
+	assert(numThreads >= 1);
+	if (numThreads > numTasks)
+		numThreads = numTasks;
+	if (numThreads <= 1) {
+		for (int taskIdx = 0; taskIdx < numTasks; taskIdx++)
+			task(arg, taskIdx);
+		return;
+	}
+
+	//threads 1..numThreads-1 run in workers[0..numUsed-1], the others (and thread 0) in the calling thread
+	while (numWorkers < numThreads - 1 && numWorkers < maxWorkers && !workerCreationFailed) {
+		if (createWorker(&workers[numWorkers]))
+			numWorkers++;
+		else
+			workerCreationFailed = true;
+	}
+	int numUsed = (numThreads - 1 < numWorkers) ? numThreads - 1 : numWorkers;
+
+#ifndef WIN32
+	pthread_mutex_lock(&poolMutex);
+#endif
+	for (int w = 0; w < numUsed; w++) {
+		ParallelThread &job = workers[w].job;
+		job.task = task;
+		job.arg = arg;
+		job.numTasks = numTasks;
+		job.firstTaskIdx = w + 1;
+		job.step = numThreads;
+#ifdef WIN32
+		doneEvents[w] = workers[w].doneEvent;
+		SetEvent(workers[w].wakeEvent);
+#else
+		workers[w].hasJob = true;
+#endif
+	}
+#ifndef WIN32
+	pendingWorkers = numUsed;
+	pthread_cond_broadcast(&workAvailable);
+	pthread_mutex_unlock(&poolMutex);
+#endif
+
+	ParallelThread thread;
+	thread.task = task;
+	thread.arg = arg;
+	thread.numTasks = numTasks;
+	thread.step = numThreads;
+	thread.firstTaskIdx = 0;
+	runParallelThread(&thread);
+	for (int t = numUsed + 1; t < numThreads; t++) {
+		thread.firstTaskIdx = t;
+		runParallelThread(&thread);
+	}
+
+#ifdef WIN32
+	if (numUsed > 0)
+		WaitForMultipleObjects(numUsed, doneEvents, TRUE, INFINITE);
+#else
+	pthread_mutex_lock(&poolMutex);
+	while (pendingWorkers > 0)
+		pthread_cond_wait(&workDone, &poolMutex);
+	pthread_mutex_unlock(&poolMutex);
+#endif
+}
+
+
+int getNumCores() {
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	return (numCores < 1) ? 1 : (int)numCores;
+#endif
+}
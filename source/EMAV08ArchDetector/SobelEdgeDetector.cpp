@@ -0,0 +1,227 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * SOBEL EDGE DETECTOR
+ * A cheap alternative to cvCanny for the blob detector (see MorphBlobDetector::setSegmentation).
+ * The edges are the pixels with a sobel 3x3 L1 gradient magnitude (|dx| + |dy|, as cvCanny)
+ * larger or equal than a single threshold: no hysteresis and no edge tracking.
+ * The edges are 2-3 pixels wide. If thin, a pixel is only kept if its magnitude is a maximum
+ * along the dominant gradient direction (horizontal if |dx| > |dy|, vertical otherwise),
+ * a simplified non-maximum suppression which gives edges of about 1 pixel, like canny.
+ * With SSE2, 8 pixels are processed at once (16 bit integers). Otherwise (e.g. ppc), the scalar code is used.
+ * The border rows and columns of roi are not edges.
+ */
+
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+#include "util.h"
+#include "SobelEdgeDetector.h"
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+SobelEdgeDetector::SobelEdgeDetector() {
+	thin = false;
+	useSimd = true;
+	capacity = 0;
+	magnitude = NULL;
+	horizontal = NULL;
+}
+
+//non-maximum suppression along the dominant gradient direction (default: false)
+void SobelEdgeDetector::setThin(bool thin) {
+	this->thin = thin;
+}
+
+SobelEdgeDetector::~SobelEdgeDetector() {
+	delete[] magnitude;
+	delete[] horizontal;
+}
+
+void SobelEdgeDetector::reserve(int width) {
+	if (width <= capacity)
+		return;
+	delete[] magnitude;
+	delete[] horizontal;
+	capacity = width;
+	magnitude = new short[3 * capacity];
+	horizontal = new short[3 * capacity];
+}
+
+
+/*
+ * Gradient magnitude and dominant direction of the row p1 (p0 above, p2 below),
+ * for the columns 1..width-2. The columns 0 and width-1 are 0.
+ */
+static void gradientRow(const uchar *p0, const uchar *p1, const uchar *p2, int width, bool simd, short *mag, short *horiz)
+{
+	mag[0] = mag[width - 1] = 0;
+	horiz[0] = horiz[width - 1] = 0;
+	int x = 1;
+#ifdef HAVE_SSE2
+	if (simd) {
+		__m128i zero = _mm_setzero_si128();
+		for (; x + 8 < width; x += 8) {
+			__m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p0 + x - 1)), zero);
+			__m128i b0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p0 + x)), zero);
+			__m128i c0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p0 + x + 1)), zero);
+			__m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p1 + x - 1)), zero);
+			__m128i c1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p1 + x + 1)), zero);
+			__m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p2 + x - 1)), zero);
+			__m128i b2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p2 + x)), zero);
+			__m128i c2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p2 + x + 1)), zero);
+
+			//dx = (c0 + 2c1 + c2) - (a0 + 2a1 + a2), dy = (a2 + 2b2 + c2) - (a0 + 2b0 + c0). |dx|, |dy| <= 1020
+			__m128i dx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(c0, c2), _mm_slli_epi16(c1, 1)),
+			                           _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)));
+			__m128i dy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(a2, c2), _mm_slli_epi16(b2, 1)),
+			                           _mm_add_epi16(_mm_add_epi16(a0, c0), _mm_slli_epi16(b0, 1)));
+			dx = _mm_max_epi16(dx, _mm_sub_epi16(zero, dx));
+			dy = _mm_max_epi16(dy, _mm_sub_epi16(zero, dy));
+			_mm_storeu_si128((__m128i*)(mag + x), _mm_add_epi16(dx, dy));
+			_mm_storeu_si128((__m128i*)(horiz + x), _mm_cmpgt_epi16(dx, dy));
+		}
+	}
+#else
+	(void)simd;     //scalar code only
+#endif
+	for (; x < width - 1; x++) {
+		int dx = (p0[x+1] + 2*p1[x+1] + p2[x+1]) - (p0[x-1] + 2*p1[x-1] + p2[x-1]);
+		int dy = (p2[x-1] + 2*p2[x] + p2[x+1]) - (p0[x-1] + 2*p0[x] + p0[x+1]);
+		dx = abs(dx);
+		dy = abs(dy);
+		mag[x] = (short)(dx + dy);
+		horiz[x] = (dx > dy) ? (short)0xffff : 0;
+	}
+}
+
+/*
+ * Edges of a row: magnitude m1 >= threshold (the columns 0 and width-1 are not edges).
+ * If thin, m1 must also be a maximum horizontally (>= left, > right) if horiz,
+ * or vertically (>= m0, > m2) otherwise.
+ */
+static void edgeRow(const short *m0, const short *m1, const short *m2, const short *horiz, int width,
+                    int threshold, bool thin, bool simd, uchar *edges)
+{
+	edges[0] = edges[width - 1] = 0;
+	int x = 1;
+#ifdef HAVE_SSE2
+	if (simd) {
+		__m128i thresholdMinus1 = _mm_set1_epi16((short)(threshold - 1));
+		for (; x + 8 < width; x += 8) {
+			__m128i m = _mm_loadu_si128((const __m128i*)(m1 + x));
+			__m128i edge = _mm_cmpgt_epi16(m, thresholdMinus1);
+			if (thin) {
+				__m128i left = _mm_loadu_si128((const __m128i*)(m1 + x - 1));
+				__m128i right = _mm_loadu_si128((const __m128i*)(m1 + x + 1));
+				__m128i up = _mm_loadu_si128((const __m128i*)(m0 + x));
+				__m128i down = _mm_loadu_si128((const __m128i*)(m2 + x));
+				__m128i h = _mm_loadu_si128((const __m128i*)(horiz + x));
+				__m128i maxH = _mm_andnot_si128(_mm_cmpgt_epi16(left, m), _mm_cmpgt_epi16(m, right));
+				__m128i maxV = _mm_andnot_si128(_mm_cmpgt_epi16(up, m), _mm_cmpgt_epi16(m, down));
+				edge = _mm_and_si128(edge, _mm_or_si128(_mm_and_si128(h, maxH), _mm_andnot_si128(h, maxV)));
+			}
+			_mm_storel_epi64((__m128i*)(edges + x), _mm_packs_epi16(edge, edge));
+		}
+	}
+#else
+	(void)simd;     //scalar code only
+#endif
+	for (; x < width - 1; x++) {
+		int m = m1[x];
+		bool edge = (m >= threshold);
+		if (edge && thin) {
+			if (horiz[x])
+				edge = (m >= m1[x-1] && m > m1[x+1]);
+			else
+				edge = (m >= m0[x] && m > m2[x]);
+		}
+		edges[x] = edge ? 255 : 0;
+	}
+}
+
+
+/*
+ * Edges of grayImage inside roi, into edgeImage (same size and roi, 8 bits, 1 channel).
+ * The pixels of edgeImage outside roi are not modified.
+ */
+void SobelEdgeDetector::detect(IplImage *grayImage, IplImage *edgeImage, CvRect roi, int threshold)
+{
+	assert(grayImage->nChannels == 1 && edgeImage->nChannels == 1);
+	assert(threshold >= 1);
+	int width = roi.width;
+	reserve(width);
+	bool simd = useSimd;
+	uchar *gray = (uchar*) grayImage->imageData + roi.y * grayImage->widthStep + roi.x;
+	uchar *edges = (uchar*) edgeImage->imageData + roi.y * edgeImage->widthStep + roi.x;
+	int grayStep = grayImage->widthStep, edgeStep = edgeImage->widthStep;
+
+	memset(edges, 0, width);
+	if (roi.height > 1)
+		memset(edges + (roi.height - 1) * edgeStep, 0, width);
+	if (roi.height < 3 || width < 3) {
+		for (int y = 1; y < roi.height - 1; y++)
+			memset(edges + y * edgeStep, 0, width);
+		return;
+	}
+
+	//magnitude row y is at (y % 3). row 0 (the roi border) has magnitude 0
+	memset(magnitude, 0, width * sizeof(short));
+	memset(horizontal, 0, width * sizeof(short));
+	for (int y = 1; y < roi.height; y++) {
+		short *mag = magnitude + (y % 3) * width;
+		short *horiz = horizontal + (y % 3) * width;
+		if (y < roi.height - 1) {
+			gradientRow(gray + (y-1)*grayStep, gray + y*grayStep, gray + (y+1)*grayStep, width, simd, mag, horiz);
+		} else {
+			memset(mag, 0, width * sizeof(short));
+			memset(horiz, 0, width * sizeof(short));
+		}
+		if (!thin) {
+			if (y < roi.height - 1)
+				edgeRow(NULL, mag, NULL, horiz, width, threshold, false, simd, edges + y * edgeStep);
+		} else if (y >= 2) {
+			//the row y-1 has both neighbours now
+			edgeRow(magnitude + ((y-2) % 3) * width, magnitude + ((y-1) % 3) * width, mag,
+			        horizontal + ((y-1) % 3) * width, width, threshold, true, simd, edges + (y-1) * edgeStep);
+		}
+	}
+}
@@ -0,0 +1,261 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * TELEMETRY HORIZON SOURCE
+ * When the airframe logs its attitude (roll and pitch), the horizon line is known without looking at the image.
+ * The attitude samples are read from a CSV file (or added with addSample, e.g. from a live link),
+ * one sample per line:
+ *   timestamp,roll,pitch
+ * in seconds and degrees, sorted by timestamp. Lines starting with # (or not starting with a number) are ignored.
+ *
+ * The frame n has the timestamp timeOffsetSecs + n / framesPerSecond,
+ * and the roll and pitch are linearly interpolated between the two nearest samples
+ * (clamped to the first and last sample).
+ *
+ * Camera model: pinhole, looking forward, with focalLengthPixels (in pixels of the full resolution video),
+ * and the principal point at the center of the full resolution frame.
+ *   roll  > 0: the horizon rotates counter-clockwise in the image, by roll degrees.
+ *   pitch > 0: the horizon moves down, focalLengthPixels*tan(pitch) pixels from the principal point.
+ * If the processed frames are cropped or downscaled by a CameraUndistort (see setImageTransform),
+ * the principal point and the focal length are converted to the coordinates of the processed frames.
+ *
+ * getHorizon returns the same Horizon as the HorizonDetector (angleR, a, b, x0, y0),
+ * with skyX,skyY and groundX,groundY at height/4 pixels from the horizon line, and image = NULL.
+ *
+ * Cross-check (optional, see setCrossCheck): every interval frames,
+ * the horizon is also computed from the image, and a warning is printed if both differ more than toleranceD degrees.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <stdio.h>
+using namespace std;
+
+#include "util.h"
+#include "TelemetryHorizonSource.h"
+
+
+TelemetryHorizonSource::TelemetryHorizonSource(double focalLengthPixels, double framesPerSecond, double timeOffsetSecs) {
+	assert(focalLengthPixels > 0);
+	assert(framesPerSecond > 0);
+	this->focalLengthPixels = focalLengthPixels;
+	this->framesPerSecond = framesPerSecond;
+	this->timeOffsetSecs = timeOffsetSecs;
+	frameCount = 0;
+	srcImage = NULL;
+	horizonImage = NULL;
+	crossCheckInterval = 0;
+	crossCheckToleranceD = 0;
+	crossCheckDetector = NULL;
+	crossCheckMaxErrorD = 0;
+	imageTransform = NULL;
+}
+
+void TelemetryHorizonSource::loadCsv(const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		throw "Cannot read the telemetry file.";
+
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		double timestamp, rollD, pitchD;
+		if (line[0] == '#' || sscanf(line, "%lf,%lf,%lf", &timestamp, &rollD, &pitchD) != 3)
+			continue;
+		addSample(timestamp, rollD, pitchD);
+	}
+	fclose(file);
+
+	if (samples.empty())
+		throw "The telemetry file has no samples.";
+	cout << "TelemetryHorizonSource. " << samples.size() << " samples, from " << samples.front().timestamp
+	     << " to " << samples.back().timestamp << " seconds" << endl;
+}
+
+void TelemetryHorizonSource::addSample(double timestamp, double rollD, double pitchD) {
+	if (!samples.empty() && timestamp < samples.back().timestamp)
+		throw "The telemetry samples must be sorted by timestamp.";
+	AttitudeSample sample;
+	sample.timestamp = timestamp;
+	sample.rollD = rollD;
+	sample.pitchD = pitchD;
+	samples.push_back(sample);
+}
+
+/*
+ * Every interval frames, computes also the horizon from the image, and compares the angle.
+ * interval = 0 disables it (default). Call it before init.
+ */
+void TelemetryHorizonSource::setCrossCheck(int interval, double toleranceD) {
+	assert(interval >= 0);
+	crossCheckInterval = interval;
+	crossCheckToleranceD = toleranceD;
+}
+
+/*
+ * The processed frames are the output of cameraUndistort, with the fused output
+ * (cropped and/or downscaled, see CameraUndistort::setFusedOutput), e.g. -cum fused or -cuscale.
+ * NULL = the frames are the full resolution video (default). Call it before init;
+ * cameraUndistort must be inited before this init (as the ArchDetector front end and the FilterVideoCapture do).
+ */
+void TelemetryHorizonSource::setImageTransform(CameraUndistort *cameraUndistort) {
+	imageTransform = cameraUndistort;
+}
+
+void TelemetryHorizonSource::init(IplImage *current_frame) {
+	cout << "TelemetryHorizonSource. init" << endl;
+	width = current_frame->width;
+	height = current_frame->height;
+	centerX = width / 2.;
+	centerY = height / 2.;
+	focal = focalLengthPixels;
+	if (imageTransform != NULL) {
+		//the center of the full frame, in the cropped and downscaled frame
+		CvSize srcSize = imageTransform->getSourceSize();
+		int downscale = imageTransform->getDownscale();
+		CvRect cropRect = imageTransform->cropRect;
+		centerX = (srcSize.width / 2. - cropRect.x + 0.5) / downscale - 0.5;
+		centerY = (srcSize.height / 2. - cropRect.y + 0.5) / downscale - 0.5;
+		focal = focalLengthPixels / downscale;
+		cout << "TelemetryHorizonSource. principal point (" << centerX << ", " << centerY << "), focal length " << focal << endl;
+	}
+	horizonImage = _cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 3);
+	if (crossCheckInterval > 0) {
+		crossCheckDetector = new HorizonDetector();
+		crossCheckDetector->init(current_frame);
+	}
+}
+
+
+//binary search of the two nearest samples, and linear interpolation
+void TelemetryHorizonSource::interpolate(double timestamp, double *rollD, double *pitchD) {
+	if (samples.empty())
+		throw "No telemetry samples.";
+	if (timestamp <= samples.front().timestamp) {
+		*rollD = samples.front().rollD;
+		*pitchD = samples.front().pitchD;
+		return;
+	}
+	if (timestamp >= samples.back().timestamp) {
+		*rollD = samples.back().rollD;
+		*pitchD = samples.back().pitchD;
+		return;
+	}
+
+	//samples[lo].timestamp <= timestamp < samples[hi].timestamp
+	int lo = 0, hi = (int)samples.size() - 1;
+	while (hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+		if (samples[mid].timestamp <= timestamp)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const AttitudeSample &s0 = samples[lo];
+	const AttitudeSample &s1 = samples[hi];
+	double t = (timestamp - s0.timestamp) / (s1.timestamp - s0.timestamp);
+
+	//the roll may wrap around +-180 degrees
+	double rollChangeD = s1.rollD - s0.rollD;
+	if (rollChangeD > 180)  rollChangeD -= 360;
+	if (rollChangeD < -180) rollChangeD += 360;
+	*rollD = s0.rollD + t * rollChangeD;
+	*pitchD = s0.pitchD + t * (s1.pitchD - s0.pitchD);
+}
+
+
+Horizon * TelemetryHorizonSource::getHorizonAt(double timestamp) {
+	double rollD, pitchD;
+	interpolate(timestamp, &rollD, &pitchD);
+
+	//angle of the horizon line, with y up, in [0, PI) as in the HorizonDetector
+	double angleR = rollD * CV_PI / 180;
+	double sinA = sin(angleR), cosA = cos(angleR);
+	double offset = focal * tan(pitchD * CV_PI / 180);
+	horizon.angleR = mod(angleR, CV_PI);
+	horizon.angleD = horizon.angleR * 180 / CV_PI;
+
+	//the point of the horizon nearest to the principal point (image coordinates, y down)
+	double x0 = centerX + offset * sinA;
+	double y0 = centerY + offset * cosA;
+	horizon.x0 = (int)x0;
+	horizon.y0 = (int)y0;
+	horizon.a = tan(horizon.angleR);
+	horizon.b = (height-horizon.y0) - horizon.a*horizon.x0;
+
+	double d = height / 4.;
+	horizon.skyX    = x0 - d * sinA;
+	horizon.skyY    = y0 - d * cosA;
+	horizon.groundX = x0 + d * sinA;
+	horizon.groundY = y0 + d * cosA;
+	horizon.image = NULL;
+	return &horizon;
+}
+
+
+Horizon * TelemetryHorizonSource::getHorizon(IplImage *srcImage) {
+	this->srcImage = srcImage;
+	double timestamp = timeOffsetSecs + frameCount / framesPerSecond;
+	getHorizonAt(timestamp);
+
+	if (crossCheckInterval > 0 && frameCount % crossCheckInterval == 0) {
+		Horizon *imageHorizon = crossCheckDetector->computeHorizon(srcImage);
+		double errorD = fmod(fabs(imageHorizon->angleD - horizon.angleD), 180);   //angleD = 0 and 180 is the same line
+		errorD = min(errorD, 180 - errorD);
+		crossCheckMaxErrorD = max(crossCheckMaxErrorD, errorD);
+		if (errorD > crossCheckToleranceD)
+			cout << "TelemetryHorizonSource. WARNING. frame " << frameCount << ", t=" << timestamp
+			     << ": telemetry horizon " << horizon.angleD << " degrees, image horizon " << imageHorizon->angleD << " degrees" << endl;
+	}
+
+	frameCount++;
+	return &horizon;
+}
+
+
+IplImage * TelemetryHorizonSource::showImage() {
+	cvCopy(srcImage, horizonImage);
+	cvLine(horizonImage, cvPoint((int)horizon.skyX, (int)horizon.skyY), cvPoint((int)horizon.groundX, (int)horizon.groundY), CV_RED, 1);
+	cvLine(horizonImage, cvPoint(0, height - (int)horizon.b), cvPoint(width, height - (int)horizon.b - (int)(horizon.a * width)), CV_GREEN, 2);
+	drawSymbol(horizonImage, 1, horizon.x0, horizon.y0, CV_BLUE);
+	return horizonImage;
+}
+
+
+TelemetryHorizonSource::~TelemetryHorizonSource() {
+	if (horizonImage != NULL)
+		cvReleaseImage(&horizonImage);
+	delete crossCheckDetector;
+}
@@ -0,0 +1,89 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* See TelemetryHorizonSource.cpp for more info */
+
+
+#ifndef __TELEMETRY_HORIZON_SOURCE_H
+#define __TELEMETRY_HORIZON_SOURCE_H
+
+#include <vector>
+
+#include "util.h"
+#include "HorizonDetector.h"
+#include "CameraUndistort.h"
+
+struct AttitudeSample {
+	double timestamp;   //seconds
+	double rollD;       //degrees
+	double pitchD;      //degrees
+};
+
+
+class TelemetryHorizonSource : public HorizonSource {
+public:
+	TelemetryHorizonSource(double focalLengthPixels, double framesPerSecond, double timeOffsetSecs);
+	void loadCsv(const char *filename);
+	void addSample(double timestamp, double rollD, double pitchD);
+	void setCrossCheck(int interval, double toleranceD);
+	void setImageTransform(CameraUndistort *cameraUndistort);
+	void init(IplImage *current_frame);
+	Horizon * getHorizon(IplImage *srcImage);
+	Horizon * getHorizonAt(double timestamp);
+	IplImage * showImage();
+	~TelemetryHorizonSource();
+
+	Horizon horizon;
+	double crossCheckMaxErrorD;   //maximum difference with the image horizon, so far
+
+private:
+	void interpolate(double timestamp, double *rollD, double *pitchD);
+
+	int width, height;
+	double focalLengthPixels;
+	CameraUndistort *imageTransform;   //NULL = the frames are the full resolution video (see setImageTransform)
+	double centerX, centerY;           //the principal point, in the processed image
+	double focal;                      //the focal length, in pixels of the processed image
+	double framesPerSecond, timeOffsetSecs;
+	std::vector<AttitudeSample> samples;
+	int frameCount;
+	IplImage *srcImage;
+	IplImage *horizonImage;
+
+	//image based cross-check (see setCrossCheck)
+	int crossCheckInterval;     //0 = disabled
+	double crossCheckToleranceD;
+	HorizonDetector *crossCheckDetector;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * EMAV08ArchDetector is a computer vision software to detect the arches
+ * from a video-stream for the EMAV08 competition.
+ *
+ *  The rules of the EMAV08 competition are given in
+ *  http://www.dgon.de/content/pdf/emav_2008_Rules_v07.pdf
+ *  (attached also in this zip file)
+ *  See also the EMAV08 website for more details: http://www.dgon.de/emav2008.htm
+ *
+ * EMAV08ArchDetector
+ * Copyright (C) 2008 David Portabella Clotet
+ *
+ * To contact the author:
+ * email: david.portabella@gmail.com
+ * web: http://david.portabella.name
+ * 
+ *
+ * This file is part of EMAV08ArchDetector
+ *  
+ * EMAV08ArchDetector is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * EMAV08ArchDetector is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with EMAV08ArchDetector.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * TILE CHANGE DETECTOR
+ * With a slow or hovering MAV, large parts of consecutive frames are nearly identical.
+ * The image is divided into tiles of tileSize x tileSize pixels, and each tile is sampled
+ * every sampleStep pixels (gray = (b + 2g + r) / 4).
+ * A tile is dirty if the mean absolute difference (SAD / samples) of its samples
+ * with the reference samples is larger than threshold (gray levels).
+ * The reference samples of a tile are updated only when it is dirty (it is going to be reprocessed),
+ * so a slow drift does not go unnoticed.
+ * All the tiles are dirty in the first frame, and every refreshInterval frames (0 = never).
+ */
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "util.h"
+#include "TileChangeDetector.h"
+
+
+static const int sampleStep = 4;
+
+
+TileChangeDetector::TileChangeDetector(int tileSize, double threshold, int refreshInterval) {
+	assert(tileSize >= sampleStep);
+	this->tileSize = tileSize;
+	this->threshold = threshold;
+	this->refreshInterval = refreshInterval;
+	dirty = NULL;
+	reference = NULL;
+	dilated = NULL;
+	stack = NULL;
+}
+
+void TileChangeDetector::init(int width, int height) {
+	this->width = width;
+	this->height = height;
+	gridWidth = (width + tileSize - 1) / tileSize;
+	gridHeight = (height + tileSize - 1) / tileSize;
+	numTiles = gridWidth * gridHeight;
+	samplesPerTile = ((tileSize + sampleStep - 1) / sampleStep) * ((tileSize + sampleStep - 1) / sampleStep);
+	dirty = new bool[numTiles];
+	dilated = new bool[numTiles];
+	stack = new int[numTiles];
+	reference = new uchar[numTiles * samplesPerTile];
+	frameCount = 0;
+	numDirtyTiles = numTiles;
+	dirtyFraction = 1;
+}
+
+TileChangeDetector::~TileChangeDetector() {
+	delete[] dirty;
+	delete[] dilated;
+	delete[] stack;
+	delete[] reference;
+}
+
+
+/*
+ * Marks the dirty tiles of srcImage (BGR), and updates their reference samples.
+ * Returns the number of dirty tiles.
+ */
+int TileChangeDetector::update(IplImage *srcImage) {
+	assert(srcImage->nChannels == 3);
+	assert(srcImage->width == width && srcImage->height == height);
+	bool refresh = (frameCount == 0 || (refreshInterval > 0 && frameCount % refreshInterval == 0));
+	frameCount++;
+
+	int step = srcImage->widthStep;
+	numDirtyTiles = 0;
+	for (int ty = 0; ty < gridHeight; ty++) {
+		for (int tx = 0; tx < gridWidth; tx++) {
+			int tile = ty * gridWidth + tx;
+			uchar *ref = reference + tile * samplesPerTile;
+			int x0 = tx * tileSize, x1 = Min(x0 + tileSize, width);
+			int y0 = ty * tileSize, y1 = Min(y0 + tileSize, height);
+
+			//sum of absolute differences
+			int sad = 0, samples = 0;
+			for (int y = y0; y < y1; y += sampleStep) {
+				uchar *p = (uchar*) srcImage->imageData + y*step + x0*3;
+				for (int x = x0; x < x1; x += sampleStep, p += 3*sampleStep, samples++)
+					sad += abs(((p[0] + 2*p[1] + p[2]) >> 2) - ref[samples]);
+			}
+			dirty[tile] = refresh || sad > threshold * samples;
+			if (!dirty[tile])
+				continue;
+			numDirtyTiles++;
+
+			//new reference
+			samples = 0;
+			for (int y = y0; y < y1; y += sampleStep) {
+				uchar *p = (uchar*) srcImage->imageData + y*step + x0*3;
+				for (int x = x0; x < x1; x += sampleStep, p += 3*sampleStep, samples++)
+					ref[samples] = (uchar)((p[0] + 2*p[1] + p[2]) >> 2);
+			}
+		}
+	}
+	dirtyFraction = (double)numDirtyTiles / numTiles;
+	return numDirtyTiles;
+}
+
+
+/*
+ * The bounding boxes (pixels) of the groups of dirty tiles (8-connected),
+ * after dilating them by marginTiles tiles (so the blobs partially inside the dirty tiles are included).
+ * If there are more than maxRegions groups, the last region is the bounding box of the remaining ones.
+ * Returns the number of regions.
+ */
+int TileChangeDetector::getDirtyRegions(int marginTiles, CvRect *regions, int maxRegions) {
+	assert(maxRegions >= 1);
+	memset(dilated, 0, numTiles * sizeof(bool));
+	for (int ty = 0; ty < gridHeight; ty++)
+		for (int tx = 0; tx < gridWidth; tx++)
+			if (dirty[ty * gridWidth + tx])
+				for (int y = Max(ty - marginTiles, 0); y <= Min(ty + marginTiles, gridHeight - 1); y++)
+					for (int x = Max(tx - marginTiles, 0); x <= Min(tx + marginTiles, gridWidth - 1); x++)
+						dilated[y * gridWidth + x] = true;
+
+	int numRegions = 0;
+	for (int start = 0; start < numTiles; start++) {
+		if (!dilated[start])
+			continue;
+		//flood fill of the group, clearing it
+		int minX = gridWidth, minY = gridHeight, maxX = -1, maxY = -1;
+		int stackSize = 0;
+		stack[stackSize++] = start;
+		dilated[start] = false;
+		while (stackSize > 0) {
+			int tile = stack[--stackSize];
+			int tx = tile % gridWidth, ty = tile / gridWidth;
+			minX = Min(minX, tx);
+			maxX = Max(maxX, tx);
+			minY = Min(minY, ty);
+			maxY = Max(maxY, ty);
+			for (int y = Max(ty - 1, 0); y <= Min(ty + 1, gridHeight - 1); y++)
+				for (int x = Max(tx - 1, 0); x <= Min(tx + 1, gridWidth - 1); x++)
+					if (dilated[y * gridWidth + x]) {
+						dilated[y * gridWidth + x] = false;
+						stack[stackSize++] = y * gridWidth + x;
+					}
+		}
+
+		CvRect rect = cvRect(minX * tileSize, minY * tileSize, 0, 0);
+		rect.width = Min((maxX + 1) * tileSize, width) - rect.x;
+		rect.height = Min((maxY + 1) * tileSize, height) - rect.y;
+		if (numRegions < maxRegions) {
+			regions[numRegions++] = rect;
+		} else {
+			CvRect &last = regions[maxRegions - 1];
+			int x1 = Max(last.x + last.width, rect.x + rect.width);
+			int y1 = Max(last.y + last.height, rect.y + rect.height);
+			last.x = Min(last.x, rect.x);
+			last.y = Min(last.y, rect.y);
+			last.width = x1 - last.x;
+			last.height = y1 - last.y;
+		}
+	}
+	return numRegions;
+}
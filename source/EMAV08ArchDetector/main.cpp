@@ -47,9 +47,13 @@
 #include "CameraUndistort.h"
 #include "CombineFrames.h"
 #include "HorizonDetector.h"
+#include "TelemetryHorizonSource.h"
 #include "MorphBlobDetector.h"
+#include "ColorLut.h"
+#include "FillErodeBlobDetector.h"
 #include "HoughTransform.h"
 #include "ArchDetector.h"
+#include "Benchmark.h"
 #include "kk.h"
 
 
@@ -95,11 +99,65 @@ char *instructions =
 	" -cup <id>          undistorts the video using predefined calibrations.\n"
 	"                    id = lense0 | lense1 | lense2 | lense3\n"
     " -cuf <filename>    undistorts the video using the calibration specified in filename.\n" 
+    " -cum <id>          undistortion method. cvUndistort2 every frame, cvRemap with precomputed\n"
+    "                    float maps, fixed point remap (sse2, -threads), or points: the arch detector\n"
+    "                    runs on the distorted frames and undistorts only the blobs and the horizon,\n"
+    "                    or fused: fixed point remap cropped to the valid region, with the gray and\n"
+    "                    sky channel images of the arch detector computed in the same pass.\n"
+    "                    id = direct | remap | fixed | points | fused. default = remap.\n"
+    " -cuscale <n>       undistortion downscale factor, with -cum fixed or fused. default = 1.\n"
     " -d <id>            image detector.\n"
-	"                    id = horion | blob | arch | none. default = arch.\n"
+	"                    id = horion | blob | fillerode | arch | none. default = arch.\n"
     " -of <filename>     saves the video output into filename, no video compression.\n"
+    " -ctf <factor>      arch detector. coarse to fine search, the fine level has factor times\n"
+    "                    the hough resolution (e.g. 2). default = 1 (disabled).\n"
+    " -refine            arch detector. refines the arch lines below the hough resolution,\n"
+    "                    fitting the blobs of both lines by least squares.\n"
+    " -bi <interval>     arch detector. runs the blob detector only every interval frames,\n"
+    "                    with a temporally decayed hough transform (half-life = interval frames).\n"
+    " -bh                arch detector. runs the blob detector on alternating image halves.\n"
+    " -roi <interval>    arch detector. once locked, runs the blob detector only around the\n"
+    "                    arch lines (+-20 pixels), and the whole frame every interval frames.\n"
+    " -ht <rows>         horizon detector. tracking, only recomputes the rows within rows of\n"
+    "                    the previous horizon (full pass every 30 frames or on large changes).\n"
+    " -bs <id>           arch detector. blob source, the blob detector or the circle detector\n"
+    "                    (circular hough transform, see -br). id = morph | circles. default = morph.\n"
+    " -br <min> <max>    circle detector. radius of the balloons, times the arch width.\n"
+    "                    default = 0.05 0.25.\n"
+    " -track <distance> <frames>\n"
+    "                    arch detector. tracks the blobs (maximum motion between frames, in pixels),\n"
+    "                    keeping the missing blobs at their predicted position for frames frames.\n"
+    " -be <id>           blob detector engine.\n"
+    "                    id = contours | labeling. default = contours.\n"
+    " -seg <id>          blob detector segmentation. canny edges, sobel edges (single threshold,\n"
+    "                    cheaper than canny, optionally thinned), or red pixels (color table).\n"
+    "                    id = canny | sobel | sobelthin | color. default = canny.\n"
+    " -ac <min> <max>    blob detector. adaptive canny thresholds, keeping the number of contours\n"
+    "                    between min and max (e.g. 20 60). default = fixed thresholds 100 200.\n"
+    " -cd <tile> <threshold>\n"
+    "                    blob detector. change detection, only reprocesses the tiles of tile x tile\n"
+    "                    pixels changed by more than threshold gray levels (e.g. 32 4).\n"
+    "                    the whole frame every 30 frames.\n"
+    " -lut <filename>    color table for -seg color (32768 bytes, b,g,r with 5 bits each).\n"
+    "                    default = red rule in hsv.\n"
+    " -threads <n>       number of worker threads (undistortion, horizon and blob detectors).\n"
+    "                    default = 1.\n"
+    " -tel <filename>    arch detector. takes the horizon from the attitude telemetry,\n"
+    "                    a CSV file with timestamp,roll,pitch (seconds, degrees).\n"
+    " -telparams <focal> <fps> <t0>\n"
+    "                    telemetry. focal length in pixels, frames per second of the video,\n"
+    "                    and timestamp of the first frame. default = 300 25 0.\n"
+    "                    the focal length is in pixels of the full resolution video\n"
+    "                    (also with the crop and the downscale of -cum fused and -cuscale).\n"
+    " -telcheck <interval>\n"
+    "                    telemetry. compares with the image horizon every interval frames.\n"
+    " -bench <id>        runs a benchmark and exits.\n"
+    "                    id = hough | horizon | horizontracking | horizonthreads | telemetry |\n"
+    "                         tilechange, sobel (-if optional) | tracker | undistort | fused |\n"
+    "                         colorlut | blobinterval | blobengine | predictedroi |\n"
+    "                         fillerode | adaptivecanny | blobthreads | circles (need -if)\n"
     "\n"
-    " (either -if or -ic is mandatory, all the other options are optional)\n"
+    " (either -if, -ic or -bench is mandatory, all the other options are optional)\n"
 	"For instance:\n"
 	"EMAV08ArchDetector -if video1-ranges2.avi -cup lense0 -d arch\n";
 
@@ -112,6 +170,46 @@ int angleDegreesMargin = 10;
 int rhoDistanceMin = 4;
 int rhoDistanceMax = 11;
 bool allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage = false;
+int fineResolutionFactor = 1;  //coarse to fine search. 1 = disabled
+bool refineArchLines = false;
+int blobDetectionInterval = 1;
+bool blobDetectionAlternateHalves = false;
+int predictedRoiFullFrameInterval = 0;  //0 = disabled
+int predictedRoiMarginPixels = 20;
+
+//HORIZON DETECTOR PARAMETERS
+int horizonTrackingBandRows = 0;  //tracking. 0 = disabled
+int horizonTrackingRefreshInterval = 30;
+double horizonTrackingResyncAngleD = 5;
+
+int numThreads = 1;
+int undistortMethod = UNDISTORT_REMAP;
+bool pointUndistortion = false;   //-cum points
+bool fusedUndistortion = false;   //-cum fused
+int undistortDownscale = 1;
+
+//BLOB DETECTOR PARAMETERS
+int blobSource = BLOB_SOURCE_MORPH;
+double circleRadiusFactorMin = 0.05;
+double circleRadiusFactorMax = 0.25;
+double trackingMaxDistance = 0;  //blob tracking. 0 = disabled
+int trackingMaxMissedFrames = 2;
+int blobEngine = BLOBS_CONTOURS;
+int segmentation = SEGMENT_CANNY;
+char *colorLutFilename = NULL;
+int adaptiveCannyMinContours = 0;
+int adaptiveCannyMaxContours = 0;  //0 = disabled
+int changeTileSize = 0;  //change detection. 0 = disabled
+double changeThreshold = 4;
+int changeRefreshInterval = 30;
+
+//TELEMETRY PARAMETERS
+char *telemetryFilename = NULL;
+double telemetryFocalLengthPixels = 300;
+double telemetryFramesPerSecond = 25;
+double telemetryTimeOffsetSecs = 0;
+int telemetryCrossCheckInterval = 0;  //0 = disabled
+double telemetryCrossCheckToleranceD = 5;
 	
 	
 int main1(int argc, char * const argv[])
@@ -121,8 +219,12 @@ int main1(int argc, char * const argv[])
 	VideoCapture *vc1 = NULL;
 	CameraUndistort *cameraUndistortProcessor = NULL;
 	ImageProcessor *imageProcessor = NULL;
+	ArchDetector *archDetector = NULL;
+	HorizonDetector *horizonDetector = NULL;
+	MorphBlobDetector *blobDetector = NULL;
 	bool imageProcessorDefined = false;
 	char *videoOutputFilename = NULL;
+	char *benchmarkId = NULL;
 
 	try {
 		for (int i = 1; i < argc; i++) {
@@ -160,6 +262,33 @@ int main1(int argc, char * const argv[])
 					throw "-cuf needs a filename.";
 				i++;
 				cameraUndistortProcessor = new CameraUndistort(argv[i]);
+			//camera undistortion method
+			} else if (strcmp(argv[i], "-cum") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-cum needs an identification.";
+				i++;
+				if (strcmp(argv[i], "direct") == 0) {
+					undistortMethod = UNDISTORT_DIRECT;
+				} else if (strcmp(argv[i], "remap") == 0) {
+					undistortMethod = UNDISTORT_REMAP;
+				} else if (strcmp(argv[i], "fixed") == 0) {
+					undistortMethod = UNDISTORT_FIXED_POINT;
+				} else if (strcmp(argv[i], "points") == 0) {
+					pointUndistortion = true;
+				} else if (strcmp(argv[i], "fused") == 0) {
+					undistortMethod = UNDISTORT_FIXED_POINT;
+					fusedUndistortion = true;
+				} else {
+					throw "-cum unknown method";
+				}
+			//undistortion downscale
+			} else if (strcmp(argv[i], "-cuscale") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-cuscale needs a factor.";
+				i++;
+				undistortDownscale = atoi(argv[i]);
+				if (undistortDownscale < 1)
+					throw "-cuscale factor must be >= 1";
 
 			//image processor
 			} else if (strcmp(argv[i], "-d") == 0) {
@@ -167,11 +296,16 @@ int main1(int argc, char * const argv[])
 					throw "-d needs an identification.";
 				i++;
 				if (strcmp(argv[i], "horizon") == 0) {
-					imageProcessor = new HorizonDetector();
+					horizonDetector = new HorizonDetector();
+					imageProcessor = horizonDetector;
 				} else if (strcmp(argv[i], "blob") == 0) {
-					imageProcessor = new MorphBlobDetector();
+					blobDetector = new MorphBlobDetector();
+					imageProcessor = blobDetector;
+				} else if (strcmp(argv[i], "fillerode") == 0) {
+					imageProcessor = new FillErodeBlobDetector();
 				} else if (strcmp(argv[i], "arch") == 0) {
-					imageProcessor = new ArchDetector(thetaResolutionDegrees, rhoResolution, angleDegreesMargin, rhoDistanceMin, rhoDistanceMax, allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage);
+					archDetector = new ArchDetector(thetaResolutionDegrees, rhoResolution, angleDegreesMargin, rhoDistanceMin, rhoDistanceMax, allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage);
+					imageProcessor = archDetector;
 				} else if (strcmp(argv[i], "none") == 0) {
 					imageProcessor = NULL;
 				} else {
@@ -184,13 +318,163 @@ int main1(int argc, char * const argv[])
 					throw "-of needs a filename.";
 				i++;
 				videoOutputFilename = argv[i];
+			//coarse to fine arch search
+			} else if (strcmp(argv[i], "-ctf") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-ctf needs a factor.";
+				i++;
+				fineResolutionFactor = atoi(argv[i]);
+				if (fineResolutionFactor < 1)
+					throw "-ctf factor must be >= 1";
+			//sub-bin refinement of the arch lines
+			} else if (strcmp(argv[i], "-refine") == 0) {
+				refineArchLines = true;
+			//skipping blob detections
+			} else if (strcmp(argv[i], "-bi") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-bi needs an interval.";
+				i++;
+				blobDetectionInterval = atoi(argv[i]);
+				if (blobDetectionInterval < 1)
+					throw "-bi interval must be >= 1";
+			} else if (strcmp(argv[i], "-bh") == 0) {
+				blobDetectionAlternateHalves = true;
+			//predicted roi
+			} else if (strcmp(argv[i], "-roi") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-roi needs an interval.";
+				i++;
+				predictedRoiFullFrameInterval = atoi(argv[i]);
+				if (predictedRoiFullFrameInterval < 1)
+					throw "-roi interval must be >= 1";
+			//horizon tracking
+			} else if (strcmp(argv[i], "-ht") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-ht needs a number of rows.";
+				i++;
+				horizonTrackingBandRows = atoi(argv[i]);
+				if (horizonTrackingBandRows < 1)
+					throw "-ht rows must be >= 1";
+			//blob source
+			} else if (strcmp(argv[i], "-bs") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-bs needs an identification.";
+				i++;
+				if (strcmp(argv[i], "morph") == 0) {
+					blobSource = BLOB_SOURCE_MORPH;
+				} else if (strcmp(argv[i], "circles") == 0) {
+					blobSource = BLOB_SOURCE_CIRCLES;
+				} else {
+					throw "-bs unknown blob source";
+				}
+			} else if (strcmp(argv[i], "-br") == 0) {
+				if ((argc - 1) < (i + 2))
+					throw "-br needs the minimum and maximum radius factors.";
+				circleRadiusFactorMin = atof(argv[++i]);
+				circleRadiusFactorMax = atof(argv[++i]);
+				if (circleRadiusFactorMin <= 0 || circleRadiusFactorMax < circleRadiusFactorMin)
+					throw "-br needs 0 < min <= max";
+			//blob tracking
+			} else if (strcmp(argv[i], "-track") == 0) {
+				if ((argc - 1) < (i + 2))
+					throw "-track needs the maximum distance and the frames.";
+				trackingMaxDistance = atof(argv[++i]);
+				trackingMaxMissedFrames = atoi(argv[++i]);
+				if (trackingMaxDistance < 1 || trackingMaxMissedFrames < 0)
+					throw "-track needs distance >= 1 and frames >= 0";
+			//blob detector engine
+			} else if (strcmp(argv[i], "-be") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-be needs an identification.";
+				i++;
+				if (strcmp(argv[i], "contours") == 0) {
+					blobEngine = BLOBS_CONTOURS;
+				} else if (strcmp(argv[i], "labeling") == 0) {
+					blobEngine = BLOBS_LABELING;
+				} else {
+					throw "-be unknown engine";
+				}
+			//blob detector segmentation
+			} else if (strcmp(argv[i], "-seg") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-seg needs an identification.";
+				i++;
+				if (strcmp(argv[i], "canny") == 0) {
+					segmentation = SEGMENT_CANNY;
+				} else if (strcmp(argv[i], "sobel") == 0) {
+					segmentation = SEGMENT_SOBEL;
+				} else if (strcmp(argv[i], "sobelthin") == 0) {
+					segmentation = SEGMENT_SOBEL_THIN;
+				} else if (strcmp(argv[i], "color") == 0) {
+					segmentation = SEGMENT_COLOR_LUT;
+				} else {
+					throw "-seg unknown segmentation";
+				}
+			//adaptive canny thresholds
+			} else if (strcmp(argv[i], "-ac") == 0) {
+				if ((argc - 1) < (i + 2))
+					throw "-ac needs the minimum and maximum number of contours.";
+				adaptiveCannyMinContours = atoi(argv[++i]);
+				adaptiveCannyMaxContours = atoi(argv[++i]);
+				if (adaptiveCannyMinContours < 1 || adaptiveCannyMaxContours < adaptiveCannyMinContours)
+					throw "-ac needs 1 <= min <= max";
+			//change detection
+			} else if (strcmp(argv[i], "-cd") == 0) {
+				if ((argc - 1) < (i + 2))
+					throw "-cd needs the tile size and the threshold.";
+				changeTileSize = atoi(argv[++i]);
+				changeThreshold = atof(argv[++i]);
+				if (changeTileSize < 8 || changeThreshold < 0)
+					throw "-cd needs tile >= 8 and threshold >= 0";
+			} else if (strcmp(argv[i], "-lut") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-lut needs a filename.";
+				i++;
+				colorLutFilename = argv[i];
+			//worker threads
+			} else if (strcmp(argv[i], "-threads") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-threads needs a number of threads.";
+				i++;
+				numThreads = atoi(argv[i]);
+				if (numThreads < 1)
+					throw "-threads must be >= 1";
+			//horizon from the telemetry
+			} else if (strcmp(argv[i], "-tel") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-tel needs a filename.";
+				i++;
+				telemetryFilename = argv[i];
+			} else if (strcmp(argv[i], "-telparams") == 0) {
+				if ((argc - 1) < (i + 3))
+					throw "-telparams needs the focal length, the frames per second and the first timestamp.";
+				telemetryFocalLengthPixels = atof(argv[++i]);
+				telemetryFramesPerSecond = atof(argv[++i]);
+				telemetryTimeOffsetSecs = atof(argv[++i]);
+				if (telemetryFocalLengthPixels <= 0 || telemetryFramesPerSecond <= 0)
+					throw "-telparams focal length and frames per second must be > 0";
+			} else if (strcmp(argv[i], "-telcheck") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-telcheck needs an interval.";
+				i++;
+				telemetryCrossCheckInterval = atoi(argv[i]);
+				if (telemetryCrossCheckInterval < 1)
+					throw "-telcheck interval must be >= 1";
+			//benchmark
+			} else if (strcmp(argv[i], "-bench") == 0) {
+				if ((argc - 1) < (i + 1))
+					throw "-bench needs an identification.";
+				i++;
+				benchmarkId = argv[i];
 			} else {
 				throw "unknown option";
 			}		
 		}
 
-		if (!vc1)
+		if (!vc1 && !benchmarkId)
 			throw "video input is mandatory";
+		if (undistortDownscale > 1 && (undistortMethod != UNDISTORT_FIXED_POINT || pointUndistortion))
+			throw "-cuscale needs -cum fixed or fused";
 
 	} catch (char const *msg) {
 		cout << "Option error: " << msg << endl;
@@ -199,11 +483,92 @@ int main1(int argc, char * const argv[])
 	}
 
 	//Undistort the image
-	VideoCapture *vc2 = (cameraUndistortProcessor == NULL) ? vc1 : new FilterVideoCapture(vc1, cameraUndistortProcessor);
+	if (cameraUndistortProcessor != NULL) {
+		cameraUndistortProcessor->setMethod(undistortMethod);
+		cameraUndistortProcessor->setNumThreads(numThreads);
+		if (undistortDownscale > 1 || fusedUndistortion)
+			cameraUndistortProcessor->setFusedOutput(fusedUndistortion, undistortDownscale, fusedUndistortion);
+	}
+	bool undistortFrames = (cameraUndistortProcessor != NULL && !pointUndistortion && !fusedUndistortion);
+	VideoCapture *vc2 = (!undistortFrames || vc1 == NULL) ? vc1 : new FilterVideoCapture(vc1, cameraUndistortProcessor);
+
+	//Benchmark, instead of playing the video
+	if (benchmarkId) {
+		runBenchmark(benchmarkId, vc2);
+		return 0;
+	}
+
+	//Color table, for the color segmentation
+	ColorLut *colorLut = NULL;
+	if (segmentation == SEGMENT_COLOR_LUT) {
+		colorLut = new ColorLut();
+		if (colorLutFilename != NULL) {
+			try {
+				colorLut->load(colorLutFilename);
+			} catch (char const *msg) {
+				cout << "Color table error: " << msg << endl;
+				return 1;
+			}
+		}
+	}
 
 	//If not specified, use the arch detector
-	if (imageProcessor == NULL && imageProcessorDefined == false)
-		imageProcessor = new ArchDetector(thetaResolutionDegrees, rhoResolution, angleDegreesMargin, rhoDistanceMin, rhoDistanceMax, allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage);
+	if (imageProcessor == NULL && imageProcessorDefined == false) {
+		archDetector = new ArchDetector(thetaResolutionDegrees, rhoResolution, angleDegreesMargin, rhoDistanceMin, rhoDistanceMax, allowOneOfTheTwoLinesToBeMomentaryOutsideTheImage);
+		imageProcessor = archDetector;
+	}
+	if (archDetector != NULL) {
+		archDetector->setCoarseToFine(fineResolutionFactor);
+		archDetector->setRefineArchLines(refineArchLines);
+		bool skipBlobDetections = (blobDetectionInterval > 1 || blobDetectionAlternateHalves);
+		archDetector->setBlobDetectionInterval(blobDetectionInterval, blobDetectionAlternateHalves, skipBlobDetections ? blobDetectionInterval : 0);
+		archDetector->setHorizonTracking(horizonTrackingBandRows, horizonTrackingRefreshInterval, horizonTrackingResyncAngleD);
+		archDetector->setNumThreads(numThreads);
+		archDetector->setBlobEngine(blobEngine);
+		archDetector->setSegmentation(segmentation, colorLut);
+		archDetector->setAdaptiveCanny(adaptiveCannyMinContours, adaptiveCannyMaxContours);
+		archDetector->setChangeDetection(changeTileSize, changeThreshold, changeRefreshInterval);
+		archDetector->setBlobSource(blobSource, circleRadiusFactorMin, circleRadiusFactorMax);
+		archDetector->setBlobTracking(trackingMaxDistance, trackingMaxMissedFrames);
+		archDetector->setPredictedRoi(predictedRoiFullFrameInterval, predictedRoiMarginPixels);
+		if (pointUndistortion)
+			archDetector->setPointUndistortion(cameraUndistortProcessor);
+		if (fusedUndistortion)
+			archDetector->setFrontEnd(cameraUndistortProcessor);
+	} else if ((pointUndistortion || fusedUndistortion) && cameraUndistortProcessor != NULL) {
+		cout << "Option error: -cum points and fused need the arch detector" << endl;
+		return 1;
+	}
+	if (blobDetector != NULL) {
+		blobDetector->setBlobEngine(blobEngine);
+		blobDetector->setSegmentation(segmentation, colorLut);
+		blobDetector->setAdaptiveCanny(adaptiveCannyMinContours, adaptiveCannyMaxContours);
+		blobDetector->setNumThreads(numThreads);
+		blobDetector->setChangeDetection(changeTileSize, changeThreshold, changeRefreshInterval);
+	}
+	TelemetryHorizonSource *telemetryHorizonSource = NULL;
+	if (telemetryFilename != NULL) {
+		if (archDetector == NULL) {
+			cout << "Option error: -tel needs the arch detector" << endl;
+			return 1;
+		}
+		telemetryHorizonSource = new TelemetryHorizonSource(telemetryFocalLengthPixels, telemetryFramesPerSecond, telemetryTimeOffsetSecs);
+		try {
+			telemetryHorizonSource->loadCsv(telemetryFilename);
+		} catch (char const *msg) {
+			cout << "Telemetry error: " << msg << endl;
+			return 1;
+		}
+		telemetryHorizonSource->setCrossCheck(telemetryCrossCheckInterval, telemetryCrossCheckToleranceD);
+		if (cameraUndistortProcessor != NULL && (fusedUndistortion || undistortDownscale > 1))
+			telemetryHorizonSource->setImageTransform(cameraUndistortProcessor);
+		archDetector->setHorizonSource(telemetryHorizonSource);
+	}
+	if (horizonDetector != NULL) {
+		if (horizonTrackingBandRows > 0)
+			horizonDetector->setTracking(horizonTrackingBandRows, horizonTrackingRefreshInterval, horizonTrackingResyncAngleD);
+		horizonDetector->setNumThreads(numThreads);
+	}
 
 	//Detector: horizon, blob, arch or none
 	VideoCapture *vc3 = (imageProcessor == NULL) ? vc2 : new FilterVideoCapture(vc2, imageProcessor);
@@ -223,8 +588,11 @@ int main1(int argc, char * const argv[])
 		delete vc3;
 		delete imageProcessor;
 	}
+	delete telemetryHorizonSource;
+	delete colorLut;
 	if (cameraUndistortProcessor != NULL) {
-		delete vc2; 
+		if (vc2 != vc1)
+			delete vc2; 
 		delete cameraUndistortProcessor;
 	}
 	delete vc1;
@@ -34,15 +34,32 @@
 
 /*
  * Find all the circles in the image
+ *
+ * processImage looks for circles of any radius in the whole image (a test, too slow and noisy).
+ * findCircles is the blob source of the ArchDetector (see ArchDetector::setBlobSource):
+ * the accumulator of cvHoughCircles is restricted to the radius interval of the balloons
+ * (predicted from the size of the arch) and to the roi (predicted from the arch lines).
+ * The centers are returned as the blobCentroid of MorphBlobDetector, for the hough transform of the lines.
  */
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 #include "util.h"
 #include "testCircle.h"
 
 
+TestCircle::TestCircle() {
+	storage = NULL;
+	draw_image = NULL;
+	gray_image = NULL;
+	blobCentroid = NULL;
+	blobRadius = NULL;
+	numBlobs = 0;
+	blobCapacity = 0;
+}
+
 void TestCircle::init(IplImage *current_frame) {
 	storage = cvCreateMemStorage(0);
 	assert (storage);
@@ -51,12 +68,55 @@ void TestCircle::init(IplImage *current_frame) {
 	assert (draw_image);
 	gray_image    = cvCreateImage(cvSize (current_frame->width, current_frame->height), IPL_DEPTH_8U, 1);
 	assert (gray_image);
+
+	blobCapacity = 256;
+	blobCentroid = new int[blobCapacity][2];
+	blobRadius = new int[blobCapacity];
+	numBlobs = 0;
 }
 
 TestCircle::~TestCircle() {
 	cvReleaseMemStorage(&storage);
 	cvReleaseImage(&draw_image);
 	cvReleaseImage(&gray_image);
+	delete[] blobCentroid;
+	delete[] blobRadius;
+}
+
+
+/*
+ * The circles with radius in [minRadius, maxRadius] and center inside roi (image coordinates).
+ * Neighbour balloons touch, so the centers are at least 2*minRadius apart,
+ * and a circle needs votes from at least half the circumference of the smallest one.
+ */
+void TestCircle::findCircles(IplImage *src_image, CvRect roi, int minRadius, int maxRadius)
+{
+	assert(minRadius >= 1 && minRadius <= maxRadius);
+	cvClearMemStorage(storage);
+
+	cvSetImageROI(src_image, roi);
+	cvSetImageROI(gray_image, roi);
+	cvCvtColor (src_image, gray_image, CV_BGR2GRAY);
+	cvSmooth( gray_image, gray_image, CV_GAUSSIAN, 3, 3 ); // smooth it, otherwise a lot of false circles may be detected
+	int accumulatorThreshold = Max(10, (int)(CV_PI * minRadius));
+	CvSeq* circles = cvHoughCircles( gray_image, storage, CV_HOUGH_GRADIENT, 1, 2 * minRadius, 100, accumulatorThreshold, minRadius, maxRadius );
+	cvResetImageROI(src_image);
+	cvResetImageROI(gray_image);
+
+	if (circles->total > blobCapacity) {
+		blobCapacity = Max(circles->total, 2 * blobCapacity);
+		delete[] blobCentroid;
+		delete[] blobRadius;
+		blobCentroid = new int[blobCapacity][2];
+		blobRadius = new int[blobCapacity];
+	}
+	numBlobs = circles->total;
+	for (int i = 0; i < numBlobs; i++) {
+		float* p = (float*)cvGetSeqElem( circles, i );
+		blobCentroid[i][0] = roi.x + cvRound(p[0]);
+		blobCentroid[i][1] = roi.y + cvRound(p[1]);
+		blobRadius[i] = cvRound(p[2]);
+	}
 }
 
 
@@ -35,21 +35,34 @@
 /* See testCircle.cpp for more info */
 
 
+#ifndef __TEST_CIRCLE_H
+#define __TEST_CIRCLE_H
+
 #include "util.h"
 #include "VideoCapture.h"
 
 class TestCircle : public ImageProcessor {
 //class TestCircle {
 public:
+	TestCircle();
 	void init(IplImage *current_frame);
 	IplImage * processImage(IplImage *draw_image);
-
-private:
+	void findCircles(IplImage *src_image, CvRect roi, int minRadius, int maxRadius);
 	~TestCircle();
 
+	IplImage *  gray_image;	
+
+	//the circles of the last findCircles, as the blobs of MorphBlobDetector
+	int numBlobs;
+	int (*blobCentroid)[2];
+	int *blobRadius;
+
+private:
 	CvMemStorage* storage;
 	IplImage *  draw_image;
-	IplImage *  gray_image;	
 	char str[255];
+	int blobCapacity;
 };
 
+#endif
+
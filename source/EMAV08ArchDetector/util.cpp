@@ -84,20 +84,25 @@ void drawSymbol(IplImage *image, int symbolId, int xc, int yc, CvScalar color) {
  * Returns *xc = -1 if there are not such pixels (blob area = 0)
  */
 void computeCentroid(IplImage *image, int *xc, int *yc) {
+	computeCentroid(image, cvRect(0, 0, image->width, image->height), xc, yc);
+}
+
+/*
+ * The same, but only looking at the pixels inside rect (e.g. the bounding box of the blob).
+ * xc, yc are image coordinates.
+ */
+void computeCentroid(IplImage *image, CvRect rect, int *xc, int *yc) {
 	uchar  *data  = (uchar*) image->imageData;
 	int    iwd       = image->widthStep;
 	assert(image->nChannels == 1);
 
-	int width = image->width;
-	int height = image->height;
-
 	//make sure that the image is small enough to accumate the mean, or change the code
 	int xAccum = 0, yAccum = 0;
 	int numPixels = 0;
-	uchar *dataY = data;
-	for (int y = 0; y < height; y++, dataY+=iwd) {
+	uchar *dataY = data + rect.y*iwd + rect.x;
+	for (int y = rect.y; y < rect.y + rect.height; y++, dataY+=iwd) {
 		uchar *dataX = dataY;
-		for (int x = 0; x < width; x++, dataX++) {
+		for (int x = rect.x; x < rect.x + rect.width; x++, dataX++) {
 			if (*dataX) {
 				xAccum += x;
 				yAccum += y;
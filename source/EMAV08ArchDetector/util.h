@@ -36,6 +36,10 @@
 #define __UTIL_H
 
 #include <stdio.h>
+#include <time.h>
+#ifndef WIN32
+  #include <sys/time.h>
+#endif
 
 #ifdef WIN32                    //MsWindows
   #include <cv.h>
@@ -44,6 +48,19 @@
   #include <OpenCV/OpenCV.h>
 #endif
 
+#ifdef WIN32
+  typedef __int64 int64;
+  typedef unsigned __int64 uint64;
+#else
+  typedef long long int64;
+  typedef unsigned long long uint64;
+#endif
+
+//SSE2 intrinsics (emmintrin.h). gcc defines __SSE2__, msvc does not (x64 always has SSE2, x86 with /arch:SSE2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define HAVE_SSE2
+#endif
+
 extern CvFont font;
 extern CvScalar CV_BLACK, CV_RED, CV_GREEN, CV_BLUE, CV_WHITE;
 void utilInit();
@@ -59,6 +76,7 @@ inline IplImage* _cvCreateImage(CvSize cvSize, int depth, int channels) {
 }
 
 void computeCentroid(IplImage *image, int *xc, int *yc);
+void computeCentroid(IplImage *image, CvRect rect, int *xc, int *yc);
 
 inline int Max(int x, int y) { return ( x > y ) ? x : y; }
 inline int Min(int x, int y) { return ( x < y ) ? x : y; }
@@ -90,6 +108,17 @@ inline int absminus(int a, int b) {
 
 
 
+//wall clock, in seconds. Used to measure the cost of each stage of the detectors.
+inline double getTimeSecs() {
+#ifdef WIN32
+	return clock() / (double)CLK_TCK;
+#else
+	timeval t; gettimeofday(&t, NULL);
+	return t.tv_sec + (double) t.tv_usec / 1000000.0;
+#endif
+}
+
+
 inline bool fileExistsAndIsReadable(const char *filename) {
 	FILE *fp = fopen(filename,"r");
 	if( fp ) {